@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
 #include "mymalloc.h"
 
 // enumeration for memory size and maximum allocation size in bytes
@@ -99,6 +101,10 @@ void program3() {
 
 // malloc() and free() arrange so that adjacent free blocks are coalesced
 void program4() {
+	// coalesce the chunks that the programs before freed, which the deferred build (-DMYMALLOC_DEFERRED) leaves on its deferred list,
+	// so that the memory starts out as one free block like in the other builds
+	mymalloc_trim();
+
 	// compute the data size of each allocation for 4 equal allocations to fill the memory completely
 	size_t size = (MEMSIZE - 72) >> 2;
 	// compute the next smaller multiple of 8 of size
@@ -113,6 +119,8 @@ void program4() {
 	// at this point, the memory is full, so free the middle two allocations
 	free(ptr2);
 	free(ptr3);
+	// the deferred build coalesces them in a batch, which mymalloc_trim runs
+	mymalloc_trim();
 
 	// now, the two adjacent free blocks should be coalesced
 	// and the data size of the free block should be 2 * size + 16 (ptr 3's metadata size in bytes)
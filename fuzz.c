@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
+#include "mymalloc.h"
+
+// enumeration for the number of allocations the driver keeps live at once, the bytes that make up one operation,
+// the operations and the largest input that is read from a file
+// every operation is 4 bytes: the operation and the size range, the allocation it works on, and 2 bytes for the size (or the alignment)
+enum {
+	SLOTS = 64,
+	OPBYTES = 4,
+	MALLOC = 0,
+	CALLOC,
+	REALLOC,
+	FREE,
+	ALIGNED,
+	TRIM,
+	NOPS,
+	MAXINPUT = 1 << 20
+};
+
+// define allocation struct for one live allocation of the driver, which is filled with its own byte so that an overlap is found
+typedef struct allocation {
+	unsigned char *ptr;
+	size_t size;
+	unsigned char fill;
+} allocation;
+
+static allocation live[SLOTS];
+static unsigned char nextFill;
+
+// printf error message and abort, so that the fuzzer records the input that got here
+static void fail(char *problem, size_t op) {
+	printf("Error: %s at operation %zu\n", problem, op);
+	abort();
+}
+
+// check that the first size bytes of an allocation still hold its fill byte, like program 6 of correctness.c does
+static void checkFill(allocation *a, size_t size, size_t op) {
+	for (size_t i = 0; i < size; i++) {
+		if (a->ptr[i] != a->fill) {
+			fail("allocation was overwritten", op);
+		}
+	}
+}
+
+// fill an allocation with a new fill byte, which is never 0 so that a calloc that skipped clearing is not mistaken for a fill
+static void fill(allocation *a) {
+	nextFill = nextFill == 255 ? 1 : nextFill + 1;
+	a->fill = nextFill;
+	memset(a->ptr, a->fill, a->size);
+}
+
+// free an allocation after checking its fill
+static void release(allocation *a, size_t op) {
+	checkFill(a, a->size, op);
+	free(a->ptr);
+	a->ptr = NULL;
+	a->size = 0;
+}
+
+// decode the size of an operation from 2 bytes and a size range, so that every tier of the allocator is reached:
+// slab slots, small chunks, large chunks and (in the growable heap) chunks with a mapping of their own
+static size_t decodeSize(unsigned range, unsigned low, unsigned high) {
+	size_t bits = low | high << 8;
+	switch (range) {
+	case 0:
+		return 1 + bits % 128;
+	case 1:
+		return 1 + bits % 1024;
+	case 2:
+		return 1 + bits;
+	default:
+		return 1 + bits * 4;
+	}
+}
+
+// run one input: decode it into operations on the live allocations, check the fill of every allocation that is freed or reallocated
+// and the heap after every operation, then free what is left and check that nothing leaks
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	size_t ops = size / OPBYTES;
+	for (size_t op = 0; op < ops; op++) {
+		const uint8_t *bytes = data + op * OPBYTES;
+		unsigned kind = bytes[0] % NOPS;
+		allocation *a = &live[bytes[1] % SLOTS];
+		size_t request = decodeSize(bytes[0] / NOPS % 4, bytes[2], bytes[3]);
+		unsigned char *ptr;
+		switch (kind) {
+		case MALLOC:
+		case CALLOC:
+		case ALIGNED:
+			if (a->ptr != NULL) {
+				release(a, op);
+			}
+			if (kind == MALLOC) {
+				ptr = malloc(request);
+			} else if (kind == CALLOC) {
+				ptr = calloc(1, request);
+				for (size_t i = 0; ptr != NULL && i < request; i++) {
+					if (ptr[i] != 0) {
+						fail("calloc returned memory that is not cleared", op);
+					}
+				}
+			} else {
+				// the alignment is a power of two from 8 to 4096 taken from the size bytes
+				size_t alignment = (size_t) 8 << (bytes[2] % 10);
+				ptr = aligned_alloc(alignment, request);
+				if (ptr != NULL && (uintptr_t) ptr % alignment != 0) {
+					fail("aligned_alloc returned memory that is not aligned", op);
+				}
+			}
+			if (ptr != NULL) {
+				if ((uintptr_t) ptr % 8 != 0) {
+					fail("allocation is not aligned to 8 bytes", op);
+				}
+				a->ptr = ptr;
+				a->size = request;
+				fill(a);
+			}
+			break;
+		case REALLOC:
+			// the bytes that both sizes have in common must survive, and a failed realloc must leave the allocation as it was
+			ptr = realloc(a->ptr, request);
+			if (ptr != NULL) {
+				a->ptr = ptr;
+				checkFill(a, a->size < request ? a->size : request, op);
+				a->size = request;
+				fill(a);
+			} else if (a->ptr != NULL) {
+				checkFill(a, a->size, op);
+			}
+			break;
+		case FREE:
+			if (a->ptr != NULL) {
+				release(a, op);
+			}
+			break;
+		case TRIM:
+			// the pages that are given back must not belong to any live allocation, which the fill checks catch
+			mymalloc_trim();
+			break;
+		}
+		if (mymalloc_check_heap() != 0) {
+			fail("heap is inconsistent", op);
+		}
+	}
+	for (int i = 0; i < SLOTS; i++) {
+		if (live[i].ptr != NULL) {
+			release(&live[i], ops);
+		}
+	}
+	if (mymalloc_check_heap() != 0) {
+		fail("heap is inconsistent", ops);
+	}
+	if (isMemoryLeaking()) {
+		fail("memory is leaking", ops);
+	}
+	return 0;
+}
+
+#ifndef MYMALLOC_LIBFUZZER
+// without libFuzzer, every file named on the command line, or stdin if there is none, is one input, which is how AFL runs the driver
+// the input is read into a static buffer, so that it doesn't take memory from the heap that is being checked
+static uint8_t input[MAXINPUT];
+
+int main(int argc, char **argv) {
+	for (int i = argc > 1 ? 1 : 0; i < argc; i++) {
+		FILE *file = i == 0 ? stdin : fopen(argv[i], "rb");
+		if (file == NULL) {
+			printf("Error: could not open input file %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		size_t size = fread(input, 1, sizeof(input), file);
+		if (file != stdin) {
+			fclose(file);
+		}
+		LLVMFuzzerTestOneInput(input, size);
+		printf("Ran %zu operations from %s\n", size / OPBYTES, i == 0 ? "stdin" : argv[i]);
+	}
+	return EXIT_SUCCESS;
+}
+#endif
@@ -1,212 +1,477 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
 #include "mymalloc.h"
 
 // enumeration for memory size and maximum allocation size in bytes
 // where MEMSIZE > MAXSIZE
+// DEFAULTHEADER is the size of the chunk struct in the default build, which the compact build (-DMYMALLOC_COMPACT) is compared against
+// RUNS is the default number of timed runs of each task and WARMUP is the default number of untimed runs before them
+// MAXSAMPLES is the most latencies that are recorded for one operation of one task, and any more are only counted in the run times
 enum {
 	MEMSIZE = 4104,
-	MAXSIZE = 511
+	MAXSIZE = 511,
+	RUNS = 50,
+	WARMUP = 5,
+	NTASKS = 6,
+	MAXSAMPLES = 1 << 18,
+	DEFAULTHEADER = 16
 };
 
-// prototype for memgrind
-void memgrind();
+// enumeration for the churn mode: the number of live blocks, the number of rounds that free and refill a third of them,
+// and the smallest and largest block, which are larger than the exact bins of the allocator (at most 512 bytes),
+// so every free chunk is in a power-of-two bin, where first fit, next fit and best fit pick different chunks
+enum {
+	CHURNBLOCKS = 20000,
+	CHURNROUNDS = 40,
+	CHURNMIN = 600,
+	CHURNMAX = 8600
+};
+
+// enumeration for the output formats
+enum {
+	TEXT,
+	CSV,
+	JSON
+};
+
+// define stats struct containing the latencies of one operation (malloc, free or a whole run) of one task in nanoseconds
+// total is the sum of all latencies, including the ones that did not fit in samples
+typedef struct stats {
+	uint64_t samples[MAXSAMPLES];
+	size_t count;
+	size_t recorded;
+	uint64_t total;
+} stats;
 
-// Your program should run each task 50 times, recording the amount of time needed for each iteration,
-// and then reporting the average time needed for each iteration. You may use gettimeofday() to obtain timing information.
-int main() {
+// the latencies of malloc, free and whole runs of the task that is running, which are only recorded after the warmup runs
+static stats mallocStats;
+static stats freeStats;
+static stats runStats;
+static bool recording;
+// task 6 takes the stats of the heap at its fullest into fullStats, and after it has refilled the holes of every third block into refillStats,
+// when it runs once more after the timed runs with sampling set
+static bool sampling;
+static mystats fullStats;
+static mystats refillStats;
+
+// prototypes for memgrind and its churn mode
+void memgrind(int runs, int warmup, unsigned int seed, int format);
+void memgrindChurn(unsigned int seed, int format);
+void task1();
+void task2();
+void task3();
+void task4();
+void task5();
+void task6();
+
+// Run each task RUNS times after WARMUP untimed runs, timing every malloc() and free() call as well as every run,
+// and report the percentiles, mean, standard deviation and throughput of each.
+// Arguments: --runs N, --warmup N, --seed N, and --csv or --json to print machine-readable results instead of text.
+// With --churn, run the churn mode instead of the tasks, which needs a growable heap (memgrind_churn and memgrind_churn_bestfit).
+int main(int argc, char **argv) {
+	int runs = RUNS;
+	int warmup = WARMUP;
+	unsigned int seed = 1;
+	int format = TEXT;
+	bool churn = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--churn") == 0) {
+			churn = true;
+		} else if (strcmp(argv[i], "--csv") == 0) {
+			format = CSV;
+		} else if (strcmp(argv[i], "--json") == 0) {
+			format = JSON;
+		} else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = (unsigned int) atoi(argv[++i]);
+		} else {
+			printf("Usage: %s [--runs N] [--warmup N] [--seed N] [--churn] [--csv | --json]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (runs < 1 || warmup < 0) {
+		printf("Error: number of runs must be at least 1 and number of warmup runs must be at least 0\n");
+		return EXIT_FAILURE;
+	}
 	// call memgrind function
-	memgrind();
-	
+	if (churn) {
+		memgrindChurn(seed, format);
+	} else {
+		memgrind(runs, warmup, seed, format);
+	}
+
 	// return successful exit status
 	return EXIT_SUCCESS;
 }
 
+// read the raw monotonic clock in nanoseconds, which is not adjusted by NTP, so two readings only differ by elapsed time
+static uint64_t now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+// record a latency if the warmup runs are over
+static void record(stats *s, uint64_t latency) {
+	if (!recording) {
+		return;
+	}
+	if (s->recorded < MAXSAMPLES) {
+		s->samples[s->recorded++] = latency;
+	}
+	s->count++;
+	s->total += latency;
+}
+
+// call malloc() and record how long it took
+static char *timedMalloc(size_t size) {
+	uint64_t start = now();
+	char *ptr = malloc(size);
+	record(&mallocStats, now() - start);
+	return ptr;
+}
+
+// call free() and record how long it took
+static void timedFree(char *ptr) {
+	uint64_t start = now();
+	free(ptr);
+	record(&freeStats, now() - start);
+}
+
 // 1. malloc() and immediately free() a 1-byte chunk, 120 times.
-double task1() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		int j;
-		for (j = 0; j < 120; j++) {
-			char *ptr = malloc(1);
-			if (ptr != NULL) {
-				free(ptr);
-			}
+void task1() {
+	int j;
+	for (j = 0; j < 120; j++) {
+		char *ptr = timedMalloc(1);
+		if (ptr != NULL) {
+			timedFree(ptr);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
 	}
-	return time / 50;
 }
 
 // 2. Use malloc() to get 120 1-byte chunks, storing the pointers in an array, then use free() to deallocate the chunks
-double task2() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		char *p[120];
-		int j;
-		for (j = 0; j < 120; j++) {
-			p[j] = malloc(1);
-		}
-		for (j = 0; j < 120; j++) {
-			if (p[j] != NULL) {
-				free(p[j]);
-			}
+void task2() {
+	char *p[120];
+	int j;
+	for (j = 0; j < 120; j++) {
+		p[j] = timedMalloc(1);
+	}
+	for (j = 0; j < 120; j++) {
+		if (p[j] != NULL) {
+			timedFree(p[j]);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
 	}
-	return time / 50;
 }
 
-// 3. Randomly choose between 
+// 3. Randomly choose between
 // a) Allocating a 1-byte chunk and storing the pointer in an array
 // b) Deallocating one of the chunks in the array (if any)
 // Repeat above until you have called malloc() 120 times, regardless of the number of iterations
-double task3() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		char *p[120];
-		int malloc_count = 0;
-		int index = 0;
-		while (malloc_count < 120) {
-			int r = rand() % 2;
-			if (r == 0) {
-				p[index] = malloc(1);
-				malloc_count++;
-				index++;
-			} else {
-				if (index > 0) {
-					if (p[index - 1] != NULL) {
-						free(p[index - 1]);
-					}
-					index--;
+void task3() {
+	char *p[120];
+	int malloc_count = 0;
+	int index = 0;
+	while (malloc_count < 120) {
+		int r = rand() % 2;
+		if (r == 0) {
+			p[index] = timedMalloc(1);
+			malloc_count++;
+			index++;
+		} else {
+			if (index > 0) {
+				if (p[index - 1] != NULL) {
+					timedFree(p[index - 1]);
 				}
+				index--;
 			}
 		}
-		while (index > 0) {
-			if (p[index - 1] != NULL) {
-				free(p[index - 1]);
-			}
-			index--;
+	}
+	while (index > 0) {
+		if (p[index - 1] != NULL) {
+			timedFree(p[index - 1]);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+		index--;
 	}
-	return time / 50;
 }
 
 // 4. Repeat number 1 but with a variable number of bytes to allocate called size, including from 0 to MAXSIZE bytes
 // if malloc returns NULL, then don't free it
-double task4() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		int j;
-		for (j = 0; j < 120; j++) {
-			char *p = malloc(rand() % (MAXSIZE + 1));
-			if (p != NULL) {
-				free(p);
-			}
+void task4() {
+	int j;
+	for (j = 0; j < 120; j++) {
+		char *p = timedMalloc(rand() % (MAXSIZE + 1));
+		if (p != NULL) {
+			timedFree(p);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
 	}
-	return time / 50;
 }
 
 // 5. Repeat number 2 but with a variable number of bytes to allocate called size, including from 0 to MAXSIZE bytes
 // if malloc returns NULL, then don't free it
-double task5() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		char *p[120];
-		int j;
-		for (j = 0; j < 120; j++) {
-			p[j] = malloc(rand() % (MAXSIZE + 1));
-		}
-		for (j = 0; j < 120; j++) {
-			if (p[j] != NULL) {
-				free(p[j]);
-			}
+void task5() {
+	char *p[120];
+	int j;
+	for (j = 0; j < 120; j++) {
+		p[j] = timedMalloc(rand() % (MAXSIZE + 1));
+	}
+	for (j = 0; j < 120; j++) {
+		if (p[j] != NULL) {
+			timedFree(p[j]);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
 	}
-	return time / 50;
 }
 
 // 6. test memory fragmentation performance
-double task6() {
-	struct timeval start, end;
-	double time = 0;
-	int i;
-	for (i = 0; i < 50; i++) {
-		gettimeofday(&start, NULL);
-		char *p[MEMSIZE];
-		int index = 0;
-		// malloc until malloc returns NULL
-		// malloc random size between 0 and MAXSIZE bytes
-		while (1) {
-			p[index] = malloc(rand() % (MAXSIZE + 1));
-			if (p[index] == NULL) {
-				break;
-			}
-			index++;
+void task6() {
+	char *p[MEMSIZE];
+	int index = 0;
+	// malloc until malloc returns NULL (or the array is full, since a growable heap never runs out)
+	// malloc random size between 0 and MAXSIZE bytes
+	while (index < MEMSIZE) {
+		p[index] = timedMalloc(rand() % (MAXSIZE + 1));
+		if (p[index] == NULL) {
+			break;
 		}
-		// free every third pointer between 0 and index
-		int j;
-		for (j = 0; j < index; j++) {
-			if (j % 3 == 0) {
-				if (p[j] != NULL) {
-					free(p[j]);
-				}
+		index++;
+	}
+	if (sampling) {
+		mymalloc_stats(&fullStats);
+	}
+	// free every third pointer between 0 and index
+	int j;
+	for (j = 0; j < index; j++) {
+		if (j % 3 == 0) {
+			if (p[j] != NULL) {
+				timedFree(p[j]);
 			}
 		}
-		// malloc those freed positions again
-		for (j = 0; j < index; j++) {
-			if (j % 3 == 0) {
-				p[j] = malloc(rand() % (MAXSIZE + 1));
-			}
+	}
+	// malloc those freed positions again
+	for (j = 0; j < index; j++) {
+		if (j % 3 == 0) {
+			p[j] = timedMalloc(rand() % (MAXSIZE + 1));
 		}
-		// free all the pointers that are not NULL between 0 and index
-		for (j = 0; j < index; j++) {
-			if (p[j] != NULL) {
-				free(p[j]);
-			}
+	}
+	if (sampling) {
+		mymalloc_stats(&refillStats);
+	}
+	// free all the pointers that are not NULL between 0 and index
+	for (j = 0; j < index; j++) {
+		if (p[j] != NULL) {
+			timedFree(p[j]);
 		}
-		gettimeofday(&end, NULL);
-		time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
 	}
-	return time / 50;
+}
+
+// compare two latencies for qsort
+static int compareLatencies(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+// get the latency at a percentile of sorted samples using the nearest rank
+static uint64_t percentile(stats *s, double p) {
+	if (s->recorded == 0) {
+		return 0;
+	}
+	size_t rank = (size_t) ceil(p / 100 * s->recorded);
+	if (rank < 1) {
+		rank = 1;
+	}
+	return s->samples[rank - 1];
+}
+
+// sort the samples of an operation and print its percentiles, mean, standard deviation and throughput in the output format
+// the throughput of malloc and free is how many calls fit in a second back to back, and the throughput of a run is
+// how many malloc and free calls the task made per second of run time
+static void report(int task, char *op, stats *s, size_t ops, int format, bool *first) {
+	qsort(s->samples, s->recorded, sizeof(uint64_t), compareLatencies);
+	double mean = 0;
+	double variance = 0;
+	for (size_t i = 0; i < s->recorded; i++) {
+		mean += s->samples[i];
+	}
+	if (s->recorded > 0) {
+		mean /= s->recorded;
+	}
+	for (size_t i = 0; i < s->recorded; i++) {
+		variance += (s->samples[i] - mean) * (s->samples[i] - mean);
+	}
+	if (s->recorded > 1) {
+		variance /= s->recorded - 1;
+	}
+	double opsPerSecond = s->total > 0 ? ops * 1e9 / s->total : 0;
+	uint64_t max = s->recorded > 0 ? s->samples[s->recorded - 1] : 0;
+	if (format == TEXT) {
+		printf("Task %d %-6s %8zu ops  p50 %6llu ns  p99 %6llu ns  p99.9 %7llu ns  max %8llu ns  mean %9.1f ns  stddev %9.1f ns  %12.0f ops/s\n",
+			task, op, s->count, (unsigned long long) percentile(s, 50), (unsigned long long) percentile(s, 99),
+			(unsigned long long) percentile(s, 99.9), (unsigned long long) max, mean, sqrt(variance), opsPerSecond);
+	} else if (format == CSV) {
+		printf("%d,%s,%zu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.0f\n",
+			task, op, s->count, (unsigned long long) percentile(s, 50), (unsigned long long) percentile(s, 99),
+			(unsigned long long) percentile(s, 99.9), (unsigned long long) max, mean, sqrt(variance), opsPerSecond);
+	} else {
+		printf("%s\n    {\"task\": %d, \"op\": \"%s\", \"count\": %zu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, "
+			"\"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"ops_per_sec\": %.0f}",
+			*first ? "" : ",", task, op, s->count, (unsigned long long) percentile(s, 50), (unsigned long long) percentile(s, 99),
+			(unsigned long long) percentile(s, 99.9), (unsigned long long) max, mean, sqrt(variance), opsPerSecond);
+	}
+	*first = false;
+}
+
+// measure the cost of reading the clock, which is part of every latency, as the median of back to back readings
+static uint64_t timerOverhead() {
+	stats *s = &runStats;
+	s->recorded = 0;
+	for (int i = 0; i < 10001; i++) {
+		uint64_t start = now();
+		s->samples[s->recorded++] = now() - start;
+	}
+	qsort(s->samples, s->recorded, sizeof(uint64_t), compareLatencies);
+	return s->samples[s->recorded / 2];
 }
 
 // run all the tasks and print the results including whether there is a memory leak at the end
-void memgrind() {
-	printf("Task 1 Average Time: %f microseconds\n", task1());
-	printf("Task 2 Average Time: %f microseconds\n", task2());
-	printf("Task 3 Average Time: %f microseconds\n", task3());
-	printf("Task 4 Average Time: %f microseconds\n", task4());
-	printf("Task 5 Average Time: %f microseconds\n", task5());
-	printf("Task 6 Average Time: %f microseconds\n", task6());
-	if (isMemoryLeaking()) {
-		printf("Memory leak detected!\n");
+void memgrind(int runs, int warmup, unsigned int seed, int format) {
+	void (*tasks[NTASKS])() = { task1, task2, task3, task4, task5, task6 };
+	uint64_t overhead = timerOverhead();
+	bool first = true;
+	if (format == TEXT) {
+		printf("Timer overhead: %llu ns per reading (included in every latency), %d runs after %d warmup runs\n",
+			(unsigned long long) overhead, runs, warmup);
+	} else if (format == CSV) {
+		printf("task,op,count,p50_ns,p99_ns,p999_ns,max_ns,mean_ns,stddev_ns,ops_per_sec\n");
+	} else {
+		printf("{\n  \"timer_overhead_ns\": %llu,\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"results\": [", (unsigned long long) overhead, runs, warmup);
+	}
+	for (int t = 0; t < NTASKS; t++) {
+		memset(&mallocStats, 0, sizeof(stats));
+		memset(&freeStats, 0, sizeof(stats));
+		memset(&runStats, 0, sizeof(stats));
+		// every task starts from the same seed, so two builds of the allocator see the same sizes
+		srand(seed);
+		for (int i = 0; i < warmup + runs; i++) {
+			recording = i >= warmup;
+			uint64_t start = now();
+			tasks[t]();
+			record(&runStats, now() - start);
+		}
+		recording = false;
+		report(t + 1, "malloc", &mallocStats, mallocStats.count, format, &first);
+		report(t + 1, "free", &freeStats, freeStats.count, format, &first);
+		report(t + 1, "run", &runStats, mallocStats.count + freeStats.count, format, &first);
+	}
+	// run task 6 once more, untimed and from the same seed, and report the footprint of the heap when it is at its fullest,
+	// along with what the chunk structs of the live chunks cost and how many bytes they save over the chunk structs of the default build,
+	// and how fragmented the free chunks are once the holes are refilled, which is what the fit policy decides
+	// the part of the footprint backed by huge pages is 0 unless mymalloc.c is the huge page build (-DMYMALLOC_HUGEPAGES)
+	// every live block of memgrind is small enough to be a slot or a chunk in an arena, so the header bytes are chunk structs only
+	srand(seed);
+	sampling = true;
+	task6();
+	sampling = false;
+	size_t chunks = fullStats.headerBytes / fullStats.chunkHeader;
+	size_t saved = chunks * (DEFAULTHEADER - fullStats.chunkHeader);
+	if (format == TEXT) {
+		printf("Footprint: %zu bytes, task 6 at its fullest holds %zu live bytes in %zu blocks, %zu chunks with %zu-byte chunk structs take %zu bytes, "
+			"%zu bytes saved\n", fullStats.footprint, fullStats.liveBytes, fullStats.liveBlocks, chunks, fullStats.chunkHeader,
+			fullStats.headerBytes, saved);
+		printf("Huge pages: %zu of the %zu footprint bytes (%.1f%%)\n", fullStats.hugeBytes, fullStats.footprint,
+			fullStats.footprint > 0 ? 100.0 * fullStats.hugeBytes / fullStats.footprint : 0);
+		printf("Refilled: %zu free bytes in %zu free chunks, largest %zu bytes, fragmentation %.1f%%\n", refillStats.freeBytes,
+			refillStats.freeChunks, refillStats.largestFree, 100 * refillStats.fragmentation);
+	}
+	bool leaking = isMemoryLeaking();
+	if (format == TEXT) {
+		if (leaking) {
+			printf("Memory leak detected!\n");
+		} else {
+			printf("No memory leak detected!\n");
+		}
+	} else if (format == JSON) {
+		printf("\n  ],\n  \"footprint\": {\"footprint_bytes\": %zu, \"live_bytes\": %zu, \"live_blocks\": %zu, \"chunks\": %zu, "
+			"\"chunk_header_bytes\": %zu, \"header_bytes\": %zu, \"header_bytes_saved\": %zu, \"huge_page_bytes\": %zu},\n  \"refilled\": {\"free_bytes\": %zu, "
+			"\"free_chunks\": %zu, \"largest_free\": %zu, \"fragmentation\": %f},\n  \"memory_leak\": %s\n}\n",
+			fullStats.footprint, fullStats.liveBytes, fullStats.liveBlocks, chunks, fullStats.chunkHeader, fullStats.headerBytes, saved,
+			fullStats.hugeBytes, refillStats.freeBytes, refillStats.freeChunks, refillStats.largestFree, refillStats.fragmentation, leaking ? "true" : "false");
+	}
+}
+
+// the blocks of the churn mode, which are too many for the stack
+static char *churnBlocks[CHURNBLOCKS];
+
+// Use malloc() to get CHURNBLOCKS blocks of CHURNMIN to CHURNMAX bytes, then for CHURNROUNDS rounds free every third block
+// (starting from a different block each round) and malloc those positions again with new random sizes,
+// and print the mean footprint, free bytes and fragmentation (as mymalloc_stats measures them) of the heap after each refill,
+// the peak footprint and the part of it that live bytes did not need, which is where the fit policies can be compared
+void memgrindChurn(unsigned int seed, int format) {
+	srand(seed);
+	size_t failed = 0;
+	int i;
+	for (i = 0; i < CHURNBLOCKS; i++) {
+		churnBlocks[i] = malloc(CHURNMIN + rand() % (CHURNMAX - CHURNMIN));
+		if (churnBlocks[i] == NULL) {
+			failed++;
+		}
+	}
+	mystats heap;
+	double meanFootprint = 0;
+	double meanFree = 0;
+	double meanFragmentation = 0;
+	int round;
+	for (round = 0; round < CHURNROUNDS; round++) {
+		for (i = round % 3; i < CHURNBLOCKS; i += 3) {
+			if (churnBlocks[i] != NULL) {
+				free(churnBlocks[i]);
+			}
+		}
+		for (i = round % 3; i < CHURNBLOCKS; i += 3) {
+			churnBlocks[i] = malloc(CHURNMIN + rand() % (CHURNMAX - CHURNMIN));
+			if (churnBlocks[i] == NULL) {
+				failed++;
+			}
+		}
+		mymalloc_stats(&heap);
+		meanFootprint += (double) heap.footprint / CHURNROUNDS;
+		meanFree += (double) heap.freeBytes / CHURNROUNDS;
+		meanFragmentation += heap.fragmentation / CHURNROUNDS;
+	}
+	double overhead = heap.peakFootprint > 0 ? 100.0 * (heap.peakFootprint - heap.peakLiveBytes) / heap.peakFootprint : 0;
+	for (i = 0; i < CHURNBLOCKS; i++) {
+		if (churnBlocks[i] != NULL) {
+			free(churnBlocks[i]);
+		}
+	}
+	bool leaking = isMemoryLeaking();
+	if (format == TEXT) {
+		printf("Churn: %d rounds over %d blocks of %d to %d bytes, %zu failed allocations\n", CHURNROUNDS, CHURNBLOCKS, CHURNMIN, CHURNMAX, failed);
+		printf("Churn footprint: mean %.0f bytes, peak %zu bytes, %.1f%% of the peak not needed by live bytes\n", meanFootprint,
+			heap.peakFootprint, overhead);
+		printf("Churn free bytes: mean %.0f, mean fragmentation %.1f%%\n", meanFree, 100 * meanFragmentation);
+		if (leaking) {
+			printf("Memory leak detected!\n");
+		} else {
+			printf("No memory leak detected!\n");
+		}
+	} else if (format == CSV) {
+		printf("rounds,blocks,failed,mean_footprint,peak_footprint,overhead,mean_free_bytes,mean_fragmentation\n");
+		printf("%d,%d,%zu,%.0f,%zu,%.1f,%.0f,%f\n", CHURNROUNDS, CHURNBLOCKS, failed, meanFootprint, heap.peakFootprint, overhead, meanFree,
+			meanFragmentation);
 	} else {
-		printf("No memory leak detected!\n");
+		printf("{\n  \"churn\": {\"rounds\": %d, \"blocks\": %d, \"failed\": %zu, \"mean_footprint\": %.0f, \"peak_footprint\": %zu, "
+			"\"overhead\": %.1f, \"mean_free_bytes\": %.0f, \"mean_fragmentation\": %f},\n  \"memory_leak\": %s\n}\n", CHURNROUNDS, CHURNBLOCKS,
+			failed, meanFootprint, heap.peakFootprint, overhead, meanFree, meanFragmentation, leaking ? "true" : "false");
 	}
 }
@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
+#include "mymalloc.h"
+
+// enumeration for the number of malloc() calls made by each thread, the number of chunks each thread holds at once,
+// the largest number of threads, the number of blocks each thread allocates in the NUMA mode,
+// and the number of messages each thread sends in the ping-pong mode and how many fit in the ring that carries them
+enum {
+	OPS = 120000,
+	LIVE = 8,
+	MAXTHREADS = 64,
+	NUMABLOCKS = 4096,
+	MESSAGES = 1 << 20,
+	RINGSIZE = 256
+};
+
+// prototypes for memgrind with threads, its NUMA mode and its ping-pong mode
+void memgrind(int maxThreads);
+void memgrindNuma(int threads);
+void memgrindPingPong();
+
+// Run task 2 of memgrind on 1 to N threads at the same time (N is the first argument and is 4 by default),
+// and report the throughput of each thread count and how it scales compared to 1 thread.
+// With --numa as the first argument, run the NUMA mode on N threads instead (N is the second argument and is 4 by default),
+// and with --pingpong, run the ping-pong mode on 2 threads.
+// This program must be linked with mymalloc.c compiled with MYMALLOC_THREADS, and with MYMALLOC_NUMA for the NUMA mode to mean anything.
+int main(int argc, char **argv) {
+	bool numa = argc > 1 && strcmp(argv[1], "--numa") == 0;
+	if (argc > 1 && strcmp(argv[1], "--pingpong") == 0) {
+		memgrindPingPong();
+		return EXIT_SUCCESS;
+	}
+	int maxThreads = 4;
+	if (argc > (numa ? 2 : 1)) {
+		maxThreads = atoi(argv[numa ? 2 : 1]);
+	}
+	if (maxThreads < 1 || maxThreads > MAXTHREADS) {
+		printf("Error: number of threads must be between 1 and %d\n", MAXTHREADS);
+		return EXIT_FAILURE;
+	}
+	// call memgrind function
+	if (numa) {
+		memgrindNuma(maxThreads);
+	} else {
+		memgrind(maxThreads);
+	}
+
+	// return successful exit status
+	return EXIT_SUCCESS;
+}
+
+// Use malloc() to get LIVE 1-byte chunks, storing the pointers in an array, then use free() to deallocate the chunks,
+// until OPS chunks have been allocated, and return the number of times malloc() returned NULL
+void *task(void *arg) {
+	size_t failures = 0;
+	char *p[LIVE];
+	int i;
+	for (i = 0; i < OPS / LIVE; i++) {
+		int j;
+		for (j = 0; j < LIVE; j++) {
+			p[j] = malloc(1);
+			if (p[j] == NULL) {
+				failures++;
+			}
+		}
+		for (j = 0; j < LIVE; j++) {
+			if (p[j] != NULL) {
+				free(p[j]);
+			}
+		}
+	}
+	return (void *) failures;
+}
+
+// run task 2 on the given number of threads and return the elapsed time in seconds
+// the number of times malloc() returned NULL is added to failures
+double runThreads(int threads, size_t *failures) {
+	pthread_t tid[MAXTHREADS];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int i;
+	for (i = 0; i < threads; i++) {
+		pthread_create(&tid[i], NULL, task, NULL);
+	}
+	for (i = 0; i < threads; i++) {
+		void *result;
+		pthread_join(tid[i], &result);
+		*failures += (size_t) result;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// run task 2 on 1 to maxThreads threads and print the results including whether there is a memory leak at the end
+// every malloc() and free() pair counts as 1 operation
+void memgrind(int maxThreads) {
+	double base = 0;
+	int threads;
+	for (threads = 1; threads <= maxThreads; threads++) {
+		size_t failures = 0;
+		double seconds = runThreads(threads, &failures);
+		double throughput = (double) threads * OPS / seconds;
+		if (threads == 1) {
+			base = throughput;
+		}
+		printf("Threads %d: %.0f operations/second, %.2fx of 1 thread, %zu failed allocations\n", threads, throughput, throughput / base, failures);
+	}
+	if (isMemoryLeaking()) {
+		printf("Memory leak detected!\n");
+	} else {
+		printf("No memory leak detected!\n");
+	}
+}
+
+// the blocks of every thread in the NUMA mode, which the next thread frees half of, and the barrier the threads wait at before that
+static char *numaBlocks[MAXTHREADS][NUMABLOCKS];
+static pthread_barrier_t numaBarrier;
+static int numaThreads;
+
+// define numaResult struct for what one thread of the NUMA mode found out about the pages of its blocks
+typedef struct numaResult {
+	size_t localPages;
+	size_t remotePages;
+	size_t unknownPages;
+} numaResult;
+
+// find the node of the page that holds each block with move_pages, which only reports the node when no nodes are given,
+// and count the pages that are on the node of the thread and the pages that are not
+static void countPages(char **blocks, int node, numaResult *result) {
+	long pageSize = sysconf(_SC_PAGESIZE);
+	void *pages[NUMABLOCKS];
+	int status[NUMABLOCKS];
+	int i;
+	for (i = 0; i < NUMABLOCKS; i++) {
+		pages[i] = (void *) ((uintptr_t) blocks[i] & ~(uintptr_t) (pageSize - 1));
+	}
+	if (syscall(SYS_move_pages, 0, NUMABLOCKS, pages, NULL, status, 0) != 0) {
+		result->unknownPages += NUMABLOCKS;
+		return;
+	}
+	for (i = 0; i < NUMABLOCKS; i++) {
+		if (status[i] < 0) {
+			result->unknownPages++;
+		} else if (status[i] == node) {
+			result->localPages++;
+		} else {
+			result->remotePages++;
+		}
+	}
+}
+
+// Pin the thread to its CPU, use malloc() to get NUMABLOCKS blocks of 16 to 4096 bytes and touch every byte of them,
+// then check which node their pages are on, wait for the other threads and free the first half of its own blocks and the second half of the
+// blocks of the thread before it, so that frees from another node are made whenever the threads are on more than one node
+void *numaTask(void *arg) {
+	int index = (int) (intptr_t) arg;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpus > 0 ? index * cpus / numaThreads : 0, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	unsigned cpu;
+	unsigned node = 0;
+	syscall(SYS_getcpu, &cpu, &node, NULL);
+
+	numaResult *result = calloc(1, sizeof(numaResult));
+	char **blocks = numaBlocks[index];
+	int i;
+	for (i = 0; i < NUMABLOCKS; i++) {
+		size_t size = (size_t) 16 << (i % 9);
+		blocks[i] = malloc(size);
+		if (blocks[i] == NULL) {
+			printf("Error: malloc() of %zu bytes failed in thread %d\n", size, index);
+			exit(EXIT_FAILURE);
+		}
+		memset(blocks[i], index, size);
+	}
+	countPages(blocks, (int) node, result);
+
+	pthread_barrier_wait(&numaBarrier);
+	char **previous = numaBlocks[(index + numaThreads - 1) % numaThreads];
+	for (i = 0; i < NUMABLOCKS / 2; i++) {
+		free(blocks[i]);
+		free(previous[NUMABLOCKS / 2 + i]);
+	}
+	return result;
+}
+
+// run the NUMA mode on the given number of threads, spread over the CPUs of the machine, and print the share of the pages of the blocks
+// that are on the node of the thread that allocated them, and the share of the frees that were made on the node of the arena of the block
+void memgrindNuma(int threads) {
+	pthread_t tid[MAXTHREADS];
+	numaThreads = threads;
+	pthread_barrier_init(&numaBarrier, NULL, threads);
+	numaResult total = {0, 0, 0};
+	int i;
+	for (i = 0; i < threads; i++) {
+		pthread_create(&tid[i], NULL, numaTask, (void *) (intptr_t) i);
+	}
+	for (i = 0; i < threads; i++) {
+		numaResult *result;
+		pthread_join(tid[i], (void **) &result);
+		total.localPages += result->localPages;
+		total.remotePages += result->remotePages;
+		total.unknownPages += result->unknownPages;
+		free(result);
+	}
+	pthread_barrier_destroy(&numaBarrier);
+
+	mystats stats;
+	mymalloc_stats(&stats);
+	size_t pages = total.localPages + total.remotePages;
+	size_t frees = stats.localFrees + stats.remoteFrees;
+	printf("Threads %d on %zu NUMA nodes\n", threads, stats.nodes);
+	if (pages > 0) {
+		printf("Pages: %zu local, %zu remote, %.1f%% local\n", total.localPages, total.remotePages, 100.0 * total.localPages / pages);
+	} else {
+		printf("Pages: placement unknown, move_pages is not available\n");
+	}
+	if (frees > 0) {
+		printf("Frees: %zu local, %zu remote, %.1f%% local\n", stats.localFrees, stats.remoteFrees, 100.0 * stats.localFrees / frees);
+	} else {
+		printf("Frees: not counted, mymalloc.c was not compiled with MYMALLOC_NUMA\n");
+	}
+	if (isMemoryLeaking()) {
+		printf("Memory leak detected!\n");
+	} else {
+		printf("No memory leak detected!\n");
+	}
+}
+
+// define ring struct for the messages one thread of the ping-pong mode sends, which only that thread writes and only one thread reads
+// the sender moves tail and the receiver moves head, each on a cache line of its own, so the ring needs no lock
+typedef struct ring {
+	char *slots[RINGSIZE];
+	size_t tail __attribute__((aligned(64)));
+	size_t head __attribute__((aligned(64)));
+} ring;
+
+// the rings of the 2 threads, and whether each thread frees the messages of the other thread or its own
+static ring rings[2];
+static bool crossFrees;
+
+// free every message waiting in a ring and return how many there were
+static size_t receive(ring *r) {
+	size_t head = r->head;
+	size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t i;
+	for (i = head; i != tail; i++) {
+		free(r->slots[i % RINGSIZE]);
+	}
+	__atomic_store_n(&r->head, tail, __ATOMIC_RELEASE);
+	return tail - head;
+}
+
+// Use malloc() to get MESSAGES messages of 64 to 2048 bytes, write into each one and send it to the other thread through the ring of this thread,
+// and free every message that arrives in the ring of the other thread, until every message of the other thread has arrived
+// in the local run, each thread reads its own ring instead, so it frees the messages it allocated
+void *pingPongTask(void *arg) {
+	int index = (int) (intptr_t) arg;
+	ring *out = &rings[index];
+	ring *in = &rings[crossFrees ? 1 - index : index];
+	size_t received = 0;
+	size_t n;
+	for (n = 0; n < MESSAGES; n++) {
+		size_t size = (size_t) 64 << (n % 6);
+		char *message = malloc(size);
+		if (message == NULL) {
+			printf("Error: malloc() of %zu bytes failed in thread %d\n", size, index);
+			exit(EXIT_FAILURE);
+		}
+		memset(message, index, 64);
+		// wait for room in the ring, freeing what arrives meanwhile so the other thread can make room in its own ring
+		while (out->tail - __atomic_load_n(&out->head, __ATOMIC_ACQUIRE) == RINGSIZE) {
+			size_t count = receive(in);
+			if (count == 0) {
+				sched_yield();
+			}
+			received += count;
+		}
+		out->slots[out->tail % RINGSIZE] = message;
+		__atomic_store_n(&out->tail, out->tail + 1, __ATOMIC_RELEASE);
+		received += receive(in);
+	}
+	while (received < MESSAGES) {
+		size_t count = receive(in);
+		if (count == 0) {
+			sched_yield();
+		}
+		received += count;
+	}
+	return NULL;
+}
+
+// run the ping-pong task on 2 threads and return the elapsed time in seconds
+static double runPingPong(bool cross) {
+	pthread_t tid[2];
+	struct timespec start, end;
+	memset(rings, 0, sizeof(rings));
+	crossFrees = cross;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int i;
+	for (i = 0; i < 2; i++) {
+		pthread_create(&tid[i], NULL, pingPongTask, (void *) (intptr_t) i);
+	}
+	for (i = 0; i < 2; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// run the ping-pong task with every message freed by the other thread, which is the free of a producer/consumer pipeline,
+// and with every message freed by the thread that allocated it, and print both throughputs, where a malloc() and free() pair counts as 1 operation
+// the difference is what a free of memory of another thread's arena costs, which goes through the remote queue of that arena,
+// or under its lock when mymalloc.c is compiled with MYMALLOC_NOREMOTEQUEUE (memgrind_mt_noqueue), so running both builds shows what the queues gain
+void memgrindPingPong() {
+#ifdef MYMALLOC_NOREMOTEQUEUE
+	char *path = "locked arena";
+#else
+	char *path = "remote queue";
+#endif
+	double local = runPingPong(false);
+	double cross = runPingPong(true);
+	printf("Ping-pong local frees: %.0f operations/second\n", 2.0 * MESSAGES / local);
+	printf("Ping-pong remote frees (%s): %.0f operations/second, %.2fx of local frees\n", path, 2.0 * MESSAGES / cross, local / cross);
+	if (isMemoryLeaking()) {
+		printf("Memory leak detected!\n");
+	} else {
+		printf("No memory leak detected!\n");
+	}
+}
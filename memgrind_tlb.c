@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
+#include "mymalloc.h"
+
+// enumeration for the number of blocks in the list that is chased, the number of steps of the chase,
+// and the smallest and largest block, which are the hot small size classes of a pointer-chasing program
+enum {
+	BLOCKS = 1 << 20,
+	STEPS = 1 << 24,
+	MINBLOCK = 16,
+	MAXBLOCK = 128
+};
+
+// define block struct at the start of every block of the list, which holds the next block in a random order
+typedef struct block {
+	struct block *next;
+} block;
+
+// prototype for the TLB benchmark
+void memgrind(unsigned int seed);
+
+// Allocate BLOCKS blocks of MINBLOCK to MAXBLOCK bytes, link them into a list in a random order and chase the list for STEPS steps,
+// and report the time and the data TLB misses of the chase, which perf_event_open counts, and how much of the heap is backed by huge pages.
+// memgrind_tlb is built with the growable heap and memgrind_tlb_huge with the huge page build (-DMYMALLOC_HUGEPAGES),
+// so running both shows what huge pages save. The seed of the random order is the first argument and is 1 by default.
+int main(int argc, char **argv) {
+	unsigned int seed = 1;
+	if (argc > 1) {
+		seed = (unsigned int) atoi(argv[1]);
+	}
+	// call memgrind function
+	memgrind(seed);
+
+	// return successful exit status
+	return EXIT_SUCCESS;
+}
+
+// read the monotonic clock in nanoseconds
+static uint64_t now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+// open a counter of the data TLB misses of loads made by this thread in user space, or return -1 if the kernel or the machine has none
+static int openTlbCounter() {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// read the bytes of anonymous memory that the kernel backs with transparent huge pages from /proc/self/smaps_rollup,
+// which is what the kernel actually gave, or return -1 if the file can't be read
+static long anonHugeBytes() {
+	FILE *file = fopen("/proc/self/smaps_rollup", "r");
+	if (file == NULL) {
+		return -1;
+	}
+	char line[256];
+	long kb = -1;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+			break;
+		}
+	}
+	fclose(file);
+	return kb < 0 ? -1 : kb * 1024;
+}
+
+// build the list, chase it with the TLB counter running and print the results including whether there is a memory leak at the end
+// the blocks are allocated in order, so neighbors in memory are neighbors in the heap, and linked in a random order,
+// so every step of the chase is likely to land on another page than the step before it
+void memgrind(unsigned int seed) {
+	srand(seed);
+	block **blocks = malloc(BLOCKS * sizeof(block *));
+	if (blocks == NULL) {
+		printf("Error: could not allocate the array of blocks\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < BLOCKS; i++) {
+		blocks[i] = malloc(MINBLOCK + rand() % ((MAXBLOCK - MINBLOCK) / 8 + 1) * 8);
+		if (blocks[i] == NULL) {
+			printf("Error: malloc() failed at block %zu\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// shuffle the blocks with Fisher-Yates and link each one to the one after it, with the last linked back to the first
+	for (size_t i = BLOCKS - 1; i > 0; i--) {
+		size_t j = ((size_t) rand() * ((size_t) RAND_MAX + 1) + rand()) % (i + 1);
+		block *swap = blocks[i];
+		blocks[i] = blocks[j];
+		blocks[j] = swap;
+	}
+	for (size_t i = 0; i < BLOCKS; i++) {
+		blocks[i]->next = blocks[(i + 1) % BLOCKS];
+	}
+
+	int counter = openTlbCounter();
+	block *b = blocks[0];
+	uint64_t start = now();
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	for (size_t i = 0; i < STEPS; i++) {
+		b = b->next;
+	}
+	uint64_t misses = 0;
+	bool counted = false;
+	if (counter >= 0) {
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		counted = read(counter, &misses, sizeof(misses)) == sizeof(misses);
+		close(counter);
+	}
+	uint64_t elapsed = now() - start;
+
+	mystats stats;
+	mymalloc_stats(&stats);
+	// the last block reached is printed, so the compiler can't leave out the chase
+	printf("Chased %d steps over %d blocks of %d to %d bytes in %f seconds, %.1f ns per step (ended at %p)\n", STEPS, BLOCKS, MINBLOCK,
+		MAXBLOCK, elapsed / 1e9, (double) elapsed / STEPS, (void *) b);
+	if (counted) {
+		printf("dTLB load misses: %llu, %.1f per 1000 steps\n", (unsigned long long) misses, 1000.0 * misses / STEPS);
+	} else {
+		printf("dTLB load misses: not counted, perf_event_open has no data TLB counter here (see /proc/sys/kernel/perf_event_paranoid)\n");
+	}
+	printf("Heap: %zu footprint bytes, %zu backed by huge pages (%.1f%%)\n", stats.footprint, stats.hugeBytes,
+		stats.footprint > 0 ? 100.0 * stats.hugeBytes / stats.footprint : 0);
+	long anonHuge = anonHugeBytes();
+	if (anonHuge >= 0) {
+		printf("Kernel: %ld bytes of anonymous memory in transparent huge pages\n", anonHuge);
+	}
+
+	for (size_t i = 0; i < BLOCKS; i++) {
+		free(blocks[i]);
+	}
+	free(blocks);
+	if (isMemoryLeaking()) {
+		printf("Memory leak detected!\n");
+	} else {
+		printf("No memory leak detected!\n");
+	}
+}
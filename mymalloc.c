@@ -1,184 +1,3997 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#ifdef MYMALLOC_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef MYMALLOC_NUMA
+#include <sys/syscall.h>
+#endif
 #include "mymalloc.h"
+#include "mytrace.h"
 
-// enumeration for memory size variable
-// MEMSIZE is number of bytes in memory array that MUST be divisible by 8 and at least able to hold an allocation of 8 bytes of data
-enum { MEMSIZE = 4104 };
-// define memory array
-static double mem[MEMSIZE / 8];
-// define chunk struct containing size_t dataSize and a pointer to next chunk
+// the number of arenas can be set with -DMYMALLOC_ARENAS=n, and it is 8 in the thread-safe build and 1 otherwise
+#ifndef MYMALLOC_ARENAS
+#ifdef MYMALLOC_THREADS
+#define MYMALLOC_ARENAS 8
+#else
+#define MYMALLOC_ARENAS 1
+#endif
+#endif
+
+// requests of at least MYMALLOC_MMAP_THRESHOLD bytes get a mapping of their own instead of a chunk in an arena, and 0 turns this off
+// it is 128 KB in the growable build, and 0 by default otherwise, so a heap of memory arrays stays bounded by them like with the slabs
+#ifndef MYMALLOC_MMAP_THRESHOLD
+#ifdef MYMALLOC_GROWABLE
+#define MYMALLOC_MMAP_THRESHOLD (128 * 1024)
+#else
+#define MYMALLOC_MMAP_THRESHOLD 0
+#endif
+#endif
+
+// the profiling build samples 1 in MYMALLOC_PROFILE_RATE allocations, which is every allocation by default
+#ifndef MYMALLOC_PROFILE_RATE
+#define MYMALLOC_PROFILE_RATE 1
+#endif
+#if MYMALLOC_PROFILE_RATE < 1
+#error "MYMALLOC_PROFILE_RATE must be at least 1"
+#endif
+
+// every allocation is aligned to MYMALLOC_ALIGNMENT bytes, which can be 8 (the default), 16 or 64
+#ifndef MYMALLOC_ALIGNMENT
+#define MYMALLOC_ALIGNMENT 8
+#endif
+#if MYMALLOC_ALIGNMENT != 8 && MYMALLOC_ALIGNMENT != 16 && MYMALLOC_ALIGNMENT != 64
+#error "MYMALLOC_ALIGNMENT must be 8, 16 or 64"
+#endif
+
+// requests of at most MYMALLOC_SLABMAX bytes get a slot in a slab, which is a page of same-size slots, and 0 turns this off
+// slab segments are mapped with mmap, so slabs are off by default unless the heap is growable, and a heap of memory arrays stays bounded by them
+// the huge page build packs every size class up to 128 bytes into slabs by default, so the hot small blocks share the huge pages of the slab segments
+#ifndef MYMALLOC_SLABMAX
+#if defined(MYMALLOC_HUGEPAGES)
+#define MYMALLOC_SLABMAX 128
+#elif defined(MYMALLOC_GROWABLE)
+#define MYMALLOC_SLABMAX 64
+#else
+#define MYMALLOC_SLABMAX 0
+#endif
+#endif
+#if MYMALLOC_SLABMAX % MYMALLOC_ALIGNMENT != 0 || MYMALLOC_SLABMAX > 128
+#error "MYMALLOC_SLABMAX must be a multiple of MYMALLOC_ALIGNMENT and at most 128"
+#endif
+
+// the memory array of an arena has MYMALLOC_MEMSIZE bytes, which is 4104 rounded up to the alignment by default
+#ifndef MYMALLOC_MEMSIZE
+#define MYMALLOC_MEMSIZE ((4104 + MYMALLOC_ALIGNMENT - 1) & ~(MYMALLOC_ALIGNMENT - 1))
+#endif
+
+// free chunks that are not in an exact bin are picked by first fit (the default, which -DMYMALLOC_FIRSTFIT also selects),
+// by next fit with -DMYMALLOC_NEXTFIT or by best fit with -DMYMALLOC_BESTFIT
+#if defined(MYMALLOC_FIRSTFIT) + defined(MYMALLOC_NEXTFIT) + defined(MYMALLOC_BESTFIT) > 1
+#error "only one of MYMALLOC_FIRSTFIT, MYMALLOC_NEXTFIT and MYMALLOC_BESTFIT can be defined"
+#endif
+
+// -DMYMALLOC_DEFERRED defers coalescing: myfree puts a chunk on a list of its arena without touching its neighbors or the bins,
+// and the list is coalesced into the bins in one batch when an allocation finds no free chunk big enough, or when mymalloc_trim is called
+
+// pointers passed to myfree and myrealloc are checked and every misuse is reported with file and line number,
+// and -DMYMALLOC_DIAGNOSTICS=0 compiles the checks out, so that a pointer that was not obtained from malloc is undefined behavior like with the C library
+#ifndef MYMALLOC_DIAGNOSTICS
+#define MYMALLOC_DIAGNOSTICS 1
+#endif
+
+// -DMYMALLOC_HARDENED adds canaries to the chunk structs on top of the diagnostics, so myfree and myrealloc also report a chunk struct
+// that was overwritten by an overflow, which is meant for testing and staging, while -DMYMALLOC_DIAGNOSTICS=0 leaves out every check for production
+#if defined(MYMALLOC_HARDENED) && !MYMALLOC_DIAGNOSTICS
+#error "MYMALLOC_HARDENED needs MYMALLOC_DIAGNOSTICS"
+#endif
+
+// -DMYMALLOC_COMPACT halves the chunk struct to 8 bytes by storing the boundary tag and the data size (with the status bits) in 4 bytes each,
+// which leaves no room for the canaries of the hardened build and limits a chunk to less than 4 GB of data
+#if defined(MYMALLOC_COMPACT) && defined(MYMALLOC_HARDENED)
+#error "MYMALLOC_COMPACT and MYMALLOC_HARDENED can't be combined"
+#endif
+
+// -DMYMALLOC_NUMA spreads the arenas over the NUMA nodes of the machine, binds the segments of every arena to its node,
+// serves every thread from an arena of the node it runs on and sends frees of memory from another node back in batches,
+// which needs the arenas and the segments of the thread-safe growable build
+#if defined(MYMALLOC_NUMA) && !(defined(MYMALLOC_THREADS) && defined(MYMALLOC_GROWABLE))
+#error "MYMALLOC_NUMA needs MYMALLOC_THREADS and MYMALLOC_GROWABLE"
+#endif
+
+// -DMYMALLOC_NOREMOTEQUEUE leaves out the remote queues of the thread-safe build, so a free of a block of another thread's arena
+// takes the lock of that arena like any other free, which is the baseline that memgrind_mt --pingpong compares the queues with
+
+// -DMYMALLOC_HUGEPAGES backs every segment and slab segment with one 2 MB huge page, so a whole segment costs one TLB entry,
+// which needs the segments of the growable build (they are already 2 MB and aligned to their size)
+#if defined(MYMALLOC_HUGEPAGES) && !defined(MYMALLOC_GROWABLE)
+#error "MYMALLOC_HUGEPAGES needs MYMALLOC_GROWABLE"
+#endif
+
+// enumeration for memory size variable, segment size and number of arenas
+// MEMSIZE is number of bytes in memory array that MUST be divisible by the alignment and at least able to hold the smallest chunk,
+// which is checked when the allocator is compiled
+// every arena has its own free block index and its own memory, which is made of segments
+// by default, the only segment of an arena is a memory array of MEMSIZE bytes, so the heap never grows
+// in the growable build (-DMYMALLOC_GROWABLE), an arena instead maps a new segment of 2^SEGSHIFT bytes with mmap whenever it runs out of free chunks,
+// and every segment is aligned to its size, so the segment that owns a pointer is found by masking the address
+enum {
+	MEMSIZE = MYMALLOC_MEMSIZE,
+	NARENAS = MYMALLOC_ARENAS,
+	SEGSHIFT = 21,
+#ifdef MYMALLOC_GROWABLE
+	SEGMENTSIZE = 1 << SEGSHIFT
+#else
+	SEGMENTSIZE = MEMSIZE
+#endif
+};
+#ifndef MYMALLOC_GROWABLE
+// define memory arrays, one per arena
+// the memory arrays are next to each other, so the arena that owns a pointer is found by dividing its offset by MEMSIZE
+static double mem[NARENAS][MEMSIZE / 8] __attribute__((aligned(MYMALLOC_ALIGNMENT)));
+#endif
+// define chunk struct containing the boundary tag of the previous chunk and the data size of this chunk
+// data sizes are multiples of 8, so the lowest bit of dataSize is free to store whether the chunk is allocated
+// (and in the hardened build, the top 16 bits of dataSize hold a canary, see chunkCanary)
+// prevSize is the footer of the previous chunk: it is written whenever the previous chunk changes size,
+// so the previous chunk can be found in O(1) by stepping back prevSize bytes plus the chunk struct
+// in the compact build, both fields are 4 bytes, so the chunk struct of every chunk takes 8 bytes instead of 16
+#ifdef MYMALLOC_COMPACT
+typedef uint32_t chunkWord;
+#else
+typedef size_t chunkWord;
+#endif
 typedef struct chunk {
-	size_t dataSize;
-	struct chunk *next;
+	chunkWord prevSize;
+	chunkWord dataSize;
 } chunk;
-// define reserved struct containing a pointer to the first chunk
+// define reserved struct containing the number of allocated chunks in a segment
+// a growable segment also stores the arena that owns it, the links of the segment list of that arena, how far chunks have been carved into it,
+// whether it is backed by a huge page (in the huge page build), and its own chunk start bitmap (a memory array keeps its chunk start bitmap in its arena instead, so the reserved struct stays 8 bytes)
 typedef struct reserved {
-	chunk *firstChunk;
+	size_t liveChunks;
+#ifdef MYMALLOC_GROWABLE
+	struct arena *owner;
+	struct reserved *nextSegment;
+	struct reserved *prevSegment;
+	size_t touched;
+#ifdef MYMALLOC_HUGEPAGES
+	bool huge;
+#endif
+#if MYMALLOC_DIAGNOSTICS
+	uint64_t starts[SEGMENTSIZE / 8 / 64];
+#endif
+#endif
 } reserved;
-// format of memory array is:
-// reserved struct at beginning to keep track of first allocated chunk
-// after that, there is a series of chunks in the format of chunk struct followed by the data
-// example diagram: reserved struct -> chunk struct -> data -> chunk struct -> data -> chunk struct -> data -> ...
+// format of a segment (a memory array or a growable segment) is:
+// reserved struct at beginning to keep track of the number of allocated chunks
+// after that, the whole segment is a series of chunks in the format of chunk struct followed by the data, with no gaps in between
+// example diagram: reserved struct -> chunk struct -> data -> chunk struct -> data -> chunk struct -> data -> ... -> end of segment
 // data is the memory that is allocated to the user by mymalloc and freed by myfree (the user can't see the chunk struct)
-// data is variable length, so the chunk struct is used to keep track of the size of the data that is allocated to the user
-// the chunk struct is also used to keep track of the next chunk in the array in order to traverse all the chunks
-// the reserved struct is used to keep track of the first chunk in the array so that the user can traverse all the chunks
-void *mymalloc(size_t size, char *file, int line) {
-	// if MEMSIZE is less than the size of the reserved struct + chunk struct + 8 bytes of data, or
-	// if MEMSIZE is not divisible by 8, then printf error message with file and line number saying that the memory size is invalid and return NULL
-	if (MEMSIZE < sizeof(reserved) + sizeof(chunk) + 8 || ((size_t) MEMSIZE & 7) != 0) {
-		printf("Error at file %s at line %d: memory size is invalid\n", file, line);
+// the chunk struct sits right before the data, so myfree finds it by stepping back from the pointer instead of traversing the chunks
+// the next chunk starts right after the data and the previous chunk starts prevSize bytes before the chunk struct,
+// so myfree can coalesce a chunk with both of its neighbors in O(1)
+// the data of a free chunk holds a freeBlock struct that links it into the free block index
+typedef struct freeBlock {
+	struct freeBlock *nextFree;
+	struct freeBlock *prevFree;
+} freeBlock;
+// the data of a free chunk in a power-of-two bin, which is larger than SMALLMAX, holds a treeBlock struct instead,
+// which is a node of the tree of its bin: its children and the largest data size in its subtree
+typedef struct treeBlock {
+	struct treeBlock *left;
+	struct treeBlock *right;
+	size_t maxSize;
+} treeBlock;
+// enumeration for the chunk status bits, the chunk size limits and the size classes (bins) of the free block index
+// CACHED is set next to ALLOCATED while a chunk sits in a thread cache, so the user has freed it but the heap still counts it as allocated
+// MAPPED is set next to ALLOCATED on a chunk that has a mapping of its own, outside of every arena
+// MINDATA is the smallest data size of a chunk, so that the data of every free chunk can hold a freeBlock struct
+// FIRSTCHUNK is the offset of the first chunk in a segment, which is the reserved struct padded so that the data of the first chunk is aligned,
+// and the chunk struct and data of every chunk but the last add up to a multiple of the alignment, so the data of every chunk is aligned
+// MAXDATA is the largest data size of a chunk, which is a whole segment minus the reserved struct (and its padding) and chunk struct
+// bins 0 to SMALLBINS - 1 are exact classes in 8-byte steps, so data size 8 is bin 0, data size 16 is bin 1, ..., data size SMALLMAX is the last small bin
+// the remaining bins are power-of-two ranges, so data size in (SMALLMAX, 2 * SMALLMAX] is bin SMALLBINS, and so on
+// the last bin also holds every data size that is larger than its range
+enum {
+	ALLOCATED = 1,
+	CACHED = 2,
+	MAPPED = 4,
+	MINDATA = sizeof(freeBlock),
+	FIRSTCHUNK = ((sizeof(reserved) + sizeof(chunk) + MYMALLOC_ALIGNMENT - 1) & ~(MYMALLOC_ALIGNMENT - 1)) - sizeof(chunk),
+	MAXDATA = SEGMENTSIZE - FIRSTCHUNK - sizeof(chunk),
+	SMALLMAX = 512,
+	SMALLBINS = SMALLMAX / 8,
+	NBINS = 128
+};
+// a segment must hold the reserved struct and at least one chunk with the smallest data size, and a memory array must keep the alignment
+// of the memory array after it, which replaces checking the memory size on every call
+_Static_assert(SEGMENTSIZE >= FIRSTCHUNK + sizeof(chunk) + MINDATA && SEGMENTSIZE % MYMALLOC_ALIGNMENT == 0, "memory size is invalid");
+// the data size of every chunk in a segment must fit in the data size of its chunk struct
+_Static_assert((chunkWord) MAXDATA == MAXDATA, "memory size is too large for compact chunk structs");
+// enumeration for the slab tier
+// a slab is a page of SLABSIZE bytes that holds slots of one size class, which are the multiples of the alignment from MINDATA to 128
+// SLABWORDS is the number of words in the occupancy bitmap of a slab, which has 1 bit per slot of the smallest size class
+// slabs are carved from slab segments of 2^SEGSHIFT bytes, mapped like growable segments, whose first page holds the slabSegment struct
+enum {
+	SLABSIZE = 4096,
+	SLABPAGES = (1 << SEGSHIFT) / SLABSIZE,
+	SLABCLASSES = (128 - MINDATA) / 8 + 1,
+	SLABWORDS = SLABSIZE / MINDATA / 64
+};
+// define slab struct at the start of every slab, followed by the slots
+// used has 1 bit per slot, set while the slot is allocated, so a slot is allocated by finding the first clear bit and freed by clearing its bit
+// the bits past the last slot are always set, so they are never handed out
+// cached has 1 bit per slot, set while the slot sits in a thread cache, so the user has freed it but the slab still counts it as allocated
+// a slab with free slots is linked into the list of its size class in its arena, and a slab with no allocated slots is linked into the empty list,
+// where it keeps its slot size until it is used again, so that a pointer into it is still reported as freed
+typedef struct slab {
+	struct slab *nextSlab;
+	struct slab *prevSlab;
+	uint32_t slotSize;
+	uint32_t freeSlots;
+	uint64_t used[SLABWORDS];
+	uint64_t cached[SLABWORDS];
+} slab;
+// enumeration for the offset of the first slot in a slab, which is the slab struct rounded up to 16 bytes or to the alignment if that is larger
+enum { SLABHEADER = (sizeof(slab) + (MYMALLOC_ALIGNMENT > 16 ? MYMALLOC_ALIGNMENT : 16) - 1) & ~((MYMALLOC_ALIGNMENT > 16 ? MYMALLOC_ALIGNMENT : 16) - 1) };
+// define slabSegment struct containing the number of allocated slots in a slab segment, the arena that owns it,
+// the links of the slab segment list of that arena, the number of pages that have been carved into slabs (including the first page),
+// and whether it is backed by a huge page (in the huge page build)
+typedef struct slabSegment {
+	size_t liveSlots;
+	struct arena *owner;
+	struct slabSegment *nextSegment;
+	struct slabSegment *prevSegment;
+	size_t carved;
+#ifdef MYMALLOC_HUGEPAGES
+	bool huge;
+#endif
+} slabSegment;
+// define heapStats struct containing the counters that mymalloc_stats reports, which are kept as blocks are allocated and freed
+// a block is a slot or chunk handed out by an arena, including the ones in thread caches, or a chunk with a mapping of its own,
+// and liveBytes counts their data sizes, headerBytes their chunk structs (and mapping structs), and classes their number by size class
+// freeBytes and freeChunks count the free chunks of the free block index and slabs counts the slabs carved from slab segments
+typedef struct heapStats {
+	size_t liveBytes;
+	size_t liveBlocks;
+	size_t headerBytes;
+	size_t peakLiveBytes;
+	size_t peakLiveBlocks;
+	size_t freeBytes;
+	size_t freeChunks;
+	size_t slabs;
+	size_t classes[MYSTATS_CLASSES];
+} heapStats;
+// define arena struct containing the free block index of the segments of an arena: the head of each exact bin, the root of the tree of each
+// power-of-two bin and a bitmap of the bins that are not empty
+// exact bins are used in LIFO order because every free chunk in an exact bin has the same data size
+// the tree of a power-of-two bin is a treap whose priorities are a hash of the node address, so its depth is O(log n) in expectation,
+// and every node keeps the largest data size in its subtree, so a fitting chunk is found on one path down the tree:
+// the tree is in order of data size and then address for best fit, and in address order for first fit and next fit
+// in the next fit build, rover is the address of the last chunk that was taken from a power-of-two bin, where the next search starts
+// in the deferred build, deferred is a list of the chunks that were freed but not coalesced yet, linked through their data, newest first
+// starts has 1 bit per 8 bytes of a segment, set where a chunk struct begins, so myfree can validate a pointer without traversing the chunks
+// (it is left out when diagnostics are compiled out)
+// in the growable build, the arena links its segments and every segment holds its own chunk start bitmap
+// the slab tier of an arena is a list of slabs with free slots per size class, a list of empty slabs and a list of slab segments
+// the stats of an arena are kept under its lock like the rest of it
+// in the thread-safe build, every arena has its own lock, so threads that use different arenas never wait for each other,
+// and remoteQueue is a lock-free stack of the slots and chunks of the arena that other threads have freed, on a cache line of its own
+typedef struct arena {
+	freeBlock *bins[SMALLBINS];
+	treeBlock *trees[NBINS - SMALLBINS];
+	uint64_t binmap[NBINS / 64];
+#ifdef MYMALLOC_NEXTFIT
+	char *rover;
+#endif
+#ifdef MYMALLOC_DEFERRED
+	freeBlock *deferred;
+	size_t deferredChunks;
+#endif
+#ifdef MYMALLOC_GROWABLE
+	reserved *segments;
+#elif MYMALLOC_DIAGNOSTICS
+	uint64_t starts[(MEMSIZE / 8 + 63) / 64];
+#endif
+	slab *partialSlabs[SLABCLASSES];
+	slab *emptySlabs;
+	slabSegment *slabSegments;
+	heapStats stats;
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_t lock;
+	freeBlock *remoteQueue __attribute__((aligned(64)));
+#endif
+} arena;
+#ifdef MYMALLOC_THREADS
+static arena arenas[NARENAS] = { [0 ... NARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER } };
+#else
+static arena arenas[NARENAS];
+#endif
+
+// in the thread-safe build, myfree reads chunk structs and the chunk start bitmap without holding the heap lock,
+// so those words are always read and written with relaxed atomic loads and stores, which compile to plain moves
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+
+// get the size class of a data size in the stats, where class i holds the data sizes in (2^(i-1), 2^i]
+static size_t statClass(size_t size) {
+	size_t index = size <= 1 ? 0 : 64 - __builtin_clzll((unsigned long long) (size - 1));
+	return index < MYSTATS_CLASSES ? index : MYSTATS_CLASSES - 1;
+}
+
+// count a block with size bytes of data and header bytes of chunk struct as live, or stop counting it
+// the high-water marks are only raised by raisePeaks once an allocation is complete, so a chunk that is split right away doesn't inflate them
+static void countLive(heapStats *stats, size_t size, size_t header) {
+	stats->liveBytes += size;
+	stats->liveBlocks++;
+	stats->headerBytes += header;
+	stats->classes[statClass(size)]++;
+}
+
+static void uncountLive(heapStats *stats, size_t size, size_t header) {
+	stats->liveBytes -= size;
+	stats->liveBlocks--;
+	stats->headerBytes -= header;
+	stats->classes[statClass(size)]--;
+}
+
+// raise the high-water marks of live bytes and live blocks to what is live now
+static void raisePeaks(heapStats *stats) {
+	if (stats->liveBytes > stats->peakLiveBytes) {
+		stats->peakLiveBytes = stats->liveBytes;
+	}
+	if (stats->liveBlocks > stats->peakLiveBlocks) {
+		stats->peakLiveBlocks = stats->liveBlocks;
+	}
+}
+
+// enumeration for the segment map and the kinds of mapping it records
+// the segment map has 1 byte for every 2^SEGSHIFT-byte piece of a 48-bit address space, which records what is mapped at the start of that piece
+// the map is split in 2 levels so that only the leaves that cover mappings of the heap take memory
+// a leaf has 2^MAPLEAFBITS bytes and is mapped the first time a mapping in its range is made
+// a growable segment is a HEAPSEGMENT, a chunk with a mapping of its own is a BIGSEGMENT and a slab segment is a SLABSEGMENT,
+// and once either is unmapped its byte becomes FREEDSEGMENT, so freeing a pointer into it again is reported as a double free
+enum {
+	MAPLEAFBITS = 15,
+	MAPTOP = 1 << (48 - SEGSHIFT - MAPLEAFBITS),
+	NOSEGMENT = 0,
+	HEAPSEGMENT,
+	BIGSEGMENT,
+	SLABSEGMENT,
+	FREEDSEGMENT
+};
+static uint8_t *segmentMap[MAPTOP];
+
+// get the start of the 2^SEGSHIFT-byte piece of the address space that contains an address
+static char *mapBase(void *ptr) {
+	return (char *) ((uintptr_t) ptr & ~(((uintptr_t) 1 << SEGSHIFT) - 1));
+}
+
+// the number of bytes of segments, slab segments and chunks with a mapping of their own that are mapped, which is the footprint of the heap
+// beyond the memory arrays, and the most that have ever been mapped at once
+static size_t mappedBytes;
+static size_t peakMappedBytes;
+
+// count size more bytes as mapped and raise the high-water mark if needed
+static void addMappedBytes(size_t size) {
+	size_t mapped = __atomic_add_fetch(&mappedBytes, size, __ATOMIC_RELAXED);
+	size_t peak = LOAD(&peakMappedBytes);
+	while (mapped > peak && !__atomic_compare_exchange_n(&peakMappedBytes, &peak, mapped, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+// map size bytes aligned to 2^SEGSHIFT bytes, or return NULL if mmap fails
+// mmap only guarantees page alignment, so map the size plus the alignment and unmap the parts before and after the aligned mapping
+static char *mapAligned(size_t size) {
+	size_t alignment = (size_t) 1 << SEGSHIFT;
+	char *p = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
 		return NULL;
 	}
-	// cast memory array to a char pointer so that the pointer arithmetic uses bytes instead of doubles
-	char *memory = (char *) mem;
-	// compute the smallest multiple of 8 at least as large as size
-	size = (size + 7) & ~7;
-	// if size is 0 or greater than the maximum data size, which is total memory size minus reserved and chunk struct, return NULL
-	if (size == 0 || size > MEMSIZE - sizeof(reserved) - sizeof(chunk)) {
-		return NULL;
-	}
-	// get the reserved struct from the beginning of the memory array
-	reserved *res = (reserved *) memory;
-	// if the first chunk is NULL or the end of memory array, then there are 0 allocated chunks, so allocate the first chunk based on the size
-	// set the last chunk's next pointer to the end of the memory array
-	if (res->firstChunk == NULL || (char *) res->firstChunk == (memory + MEMSIZE)) {
-		res->firstChunk = (chunk *) (memory + sizeof(reserved));
-		res->firstChunk->dataSize = size;
-		res->firstChunk->next = (chunk *) (memory + MEMSIZE);
-		return (void *) (memory + sizeof(reserved) + sizeof(chunk));
-	}
-	// if the first chunk is not NULL, then there are at least 1 allocated chunks
-	// so traverse the chunks to find free space in between the chunks that is big enough to hold data size + chunk struct
-	// free space is defined as the space between the end of the previous chunk and the beginning of the next chunk
-	// if there is no free space, then return NULL
-	// if there is free space, then allocate the chunk and return the pointer to the data
-	// update the next pointer of the previous chunk to point to the new chunk
-	// update the next pointer of the new chunk to point to the next chunk so the chunks are still linked
-
-	// if there is enough free space between the end of the reserved struct and the beginning of the first chunk, then allocate the chunk
-	// diagram: reserved struct -> free space -> first chunk -> ...
-	// set the next pointer of the new chunk to the first chunk
-	// set the first chunk pointer of the reserved struct to the new chunk
-	if ((char *) res->firstChunk - (memory + sizeof(reserved)) >= size + sizeof(chunk)) {
-		chunk *newChunk = (chunk *) (memory + sizeof(reserved));
-		newChunk->dataSize = size;
-		newChunk->next = res->firstChunk;
-		res->firstChunk = newChunk;
-		return (void *) (memory + sizeof(reserved) + sizeof(chunk));
-	}
-
-	chunk *prevChunk = res->firstChunk;
-	chunk *currChunk = prevChunk;
-	while (true) {
-		// compute the free space between the end of the previous chunk and the beginning of the next chunk
-		// if current chunk is the same as previous chunk, then set free space to 0
-		size_t freeSpace = 0;
-		if (currChunk != prevChunk) {
-			freeSpace = (char *) currChunk - (char *) prevChunk - prevChunk->dataSize - sizeof(chunk);
-		}
-		if (freeSpace >= size + sizeof(chunk)) {
-			chunk *newChunk = (chunk *) ((char *) prevChunk + prevChunk->dataSize + sizeof(chunk));
-			newChunk->dataSize = size;
-			newChunk->next = currChunk;
-			prevChunk->next = newChunk;
-			return (void *) ((char *) newChunk + sizeof(chunk));
-		}
-		// if current chunk is at the end of the memory array, then there is no free space, so break out of the loop
-		if ((char *) currChunk == (memory + MEMSIZE)) {
-			break;
+	char *aligned = mapBase(p + alignment - 1);
+	if (aligned != p) {
+		munmap(p, aligned - p);
+	}
+	if (p + alignment != aligned) {
+		munmap(aligned + size, p + alignment - aligned);
+	}
+	addMappedBytes(size);
+	return aligned;
+}
+
+// give size bytes mapped by mapAligned back to the OS
+static void unmapAligned(void *p, size_t size) {
+	munmap(p, size);
+	__atomic_fetch_sub(&mappedBytes, size, __ATOMIC_RELAXED);
+}
+
+#ifdef MYMALLOC_HUGEPAGES
+// enumeration for how segments get huge pages, which is found when the first segment is mapped:
+// transparent huge pages asked for with madvise(MADV_HUGEPAGE) when the kernel has them enabled,
+// or else explicit huge pages mapped with MAP_HUGETLB, which come from the pool reserved in /proc/sys/vm/nr_hugepages
+enum {
+	HUGEUNKNOWN,
+	HUGETRANSPARENT,
+	HUGEEXPLICIT
+};
+static int hugeMode;
+// the number of bytes of segments and slab segments that are backed by huge pages
+static size_t hugeBytes;
+
+// find how segments get huge pages from /sys/kernel/mm/transparent_hugepage/enabled, which is a list like "always [madvise] never"
+// the file is read with read() into a buffer on the stack, since stdio would allocate from the heap that is being set up
+static int findHugeMode() {
+	int mode = LOAD(&hugeMode);
+	if (mode == HUGEUNKNOWN) {
+		char buffer[64];
+		ssize_t length = -1;
+		int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+		if (fd >= 0) {
+			length = read(fd, buffer, sizeof(buffer) - 1);
+			close(fd);
 		}
-		prevChunk = currChunk;
-		currChunk = currChunk->next;
+		mode = HUGEEXPLICIT;
+		if (length > 0) {
+			buffer[length] = '\0';
+			if (strstr(buffer, "[never]") == NULL) {
+				mode = HUGETRANSPARENT;
+			}
+		}
+		STORE(&hugeMode, mode);
 	}
-	return NULL;
+	return mode;
 }
-// free the chunk that contains the pointer
-void myfree(void *ptr, char *file, int line) {
-	// if MEMSIZE is less than the size of the reserved struct + chunk struct + 8 bytes of data, or
-	// if MEMSIZE is not divisible by 8, then printf error message with file and line number saying that the memory size is invalid and return
-	if (MEMSIZE < sizeof(reserved) + sizeof(chunk) + 8 || ((size_t) MEMSIZE & 7) != 0) {
-		printf("Error at file %s at line %d: memory size is invalid\n", file, line);
+
+// map a segment of 2^SEGSHIFT bytes backed by a huge page if one can be had, and set huge to whether it is, or return NULL if mmap fails
+// a segment that gets no huge page (the pool of explicit huge pages is empty, or madvise fails) is mapped like any other,
+// so a machine without huge pages runs the build with small pages
+static char *mapSegment(bool *huge) {
+	size_t size = (size_t) 1 << SEGSHIFT;
+	char *p = NULL;
+	*huge = false;
+	if (findHugeMode() == HUGEEXPLICIT) {
+		// an explicit huge page of 2^SEGSHIFT bytes is aligned to its size, so it needs no trimming like mapAligned does
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | SEGSHIFT << MAP_HUGE_SHIFT, -1, 0);
+		if (p != MAP_FAILED) {
+			addMappedBytes(size);
+			*huge = true;
+		} else {
+			p = NULL;
+		}
+	}
+	if (p == NULL) {
+		p = mapAligned(size);
+		*huge = p != NULL && LOAD(&hugeMode) == HUGETRANSPARENT && madvise(p, size, MADV_HUGEPAGE) == 0;
+	}
+	if (*huge) {
+		__atomic_fetch_add(&hugeBytes, size, __ATOMIC_RELAXED);
+	}
+	return p;
+}
+
+// give a segment mapped by mapSegment back to the OS
+static void unmapSegment(void *p, bool huge) {
+	if (huge) {
+		__atomic_fetch_sub(&hugeBytes, (size_t) 1 << SEGSHIFT, __ATOMIC_RELAXED);
+	}
+	unmapAligned(p, (size_t) 1 << SEGSHIFT);
+}
+#else
+// without huge pages, a segment is mapped like any other mapping
+static char *mapSegment(bool *huge) {
+	*huge = false;
+	return mapAligned((size_t) 1 << SEGSHIFT);
+}
+
+static void unmapSegment(void *p, bool huge) {
+	unmapAligned(p, (size_t) 1 << SEGSHIFT);
+}
+#endif
+
+#ifdef MYMALLOC_NUMA
+// enumeration for the NUMA build: the most nodes the arenas are spread over, which is at most the number of arenas so every node has one,
+// and the memory policy of mbind that prefers a node, so a node that runs out of memory falls back to the others instead of failing
+enum {
+	MAXNODES = NARENAS < 64 ? NARENAS : 64,
+	MPOLPREFERRED = 1
+};
+// the number of nodes the arenas are spread over, which is found once by the first thread that picks an arena
+// it is 1 when the machine has one node, the kernel has no NUMA support or the memory policy calls are not allowed,
+// so without NUMA the heap works like the thread-safe growable build and nothing is bound
+static int numaNodes = 1;
+static pthread_once_t numaOnce = PTHREAD_ONCE_INIT;
+static __thread int threadNode = -1;
+
+// find the number of nodes from the last node in /sys/devices/system/node/online, which is a list like "0-1" or "0,2-3",
+// and check that the kernel takes memory policy calls with get_mempolicy
+// the file is read with read() into a buffer on the stack, since stdio would allocate from the heap that is being set up
+static void findNodes() {
+	char buffer[256];
+	int fd = open("/sys/devices/system/node/online", O_RDONLY);
+	if (fd < 0) {
 		return;
 	}
-	// cast memory array to a char pointer so that the pointer arithmetic uses bytes instead of doubles
-	char *memory = (char *) mem;
-	// get the reserved struct from the beginning of the memory array
-	reserved *res = (reserved *) memory;
-	// if the first chunk is NULL meaning the memory has never been allocated, or
-	// if the ptr is not in the range between the end of the reserved + chunk struct and the last index of the memory array, then
-	// printf error message with file and line number saying that the pointer is not obtained from malloc and return
-	if (res->firstChunk == NULL || (char *) ptr < (memory + sizeof(reserved) + sizeof(chunk)) || (char *) ptr >= (memory + MEMSIZE)) {
-		printf("Error at file %s at line %d: pointer %p is not obtained from malloc\n", file, line, ptr);
+	ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	if (length <= 0) {
 		return;
 	}
-	// if the first chunk is equal to the end of the memory array, then the memory has been allocated but has been freed,
-	// so printf error message with file and line number saying that the pointer has already been freed and return
-	if ((char *) res->firstChunk == (memory + MEMSIZE)) {
-		printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+	int last = 0;
+	for (ssize_t i = 0; i < length; i++) {
+		if (buffer[i] >= '0' && buffer[i] <= '9') {
+			last = i > 0 && buffer[i - 1] >= '0' && buffer[i - 1] <= '9' ? last * 10 + buffer[i] - '0' : buffer[i] - '0';
+		}
+	}
+	int policy;
+	if (last < 1 || syscall(SYS_get_mempolicy, &policy, NULL, 0, NULL, 0) != 0) {
 		return;
 	}
-	// if the first chunk is not NULL and not the end of the memory array, then there are at least 1 allocated chunks
-	// if the pointer is not NULL, then there is something to free
-	// so traverse the chunks to find the chunk that contains the pointer
-	// if the pointer is not found, then return
-	// if the pointer is found, then free the chunk
-	// if the pointer is found at the first chunk, then update reserved struct to point to the first chunk in the array
-	// update the next pointer of the previous chunk to point to the next chunk so the chunks are still linked
-	chunk *prevChunk = res->firstChunk;
-	chunk *currChunk = prevChunk;
+	numaNodes = last + 1 < MAXNODES ? last + 1 : MAXNODES;
+}
+
+// get the node the calling thread runs on, which is found with getcpu when the thread first asks for it
+// a thread that is moved to another node later keeps its node, like it keeps its arena
+static int localNode() {
+	if (threadNode < 0) {
+		pthread_once(&numaOnce, findNodes);
+		unsigned cpu;
+		unsigned node;
+		threadNode = numaNodes > 1 && syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ? (int) (node % numaNodes) : 0;
+	}
+	return threadNode;
+}
+
+// get the node of an arena, which is its index modulo the number of nodes
+static int arenaNode(arena *a) {
+	return (int) ((a - arenas) % numaNodes);
+}
+
+// get an arena of a node from an index, where the arenas of node n are n, n + numaNodes, n + 2 * numaNodes and so on
+static arena *nodeArena(int node, size_t index) {
+	size_t count = (NARENAS - node + numaNodes - 1) / numaNodes;
+	return &arenas[node + index % count * numaNodes];
+}
+
+// prefer a node for the pages of a new mapping before any of them is touched, so the first touch puts them on that node
+// a failed mbind leaves the pages to the default policy, which puts them where they are first touched
+static void bindNode(void *p, size_t size, int node) {
+	if (numaNodes > 1) {
+		unsigned long mask = 1UL << node;
+		// the kernel reads one bit less than the number of bits it is given, so it is given one more than the mask holds
+		syscall(SYS_mbind, p, size, MPOLPREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+	}
+}
+#else
+// without NUMA, every arena and every thread is on node 0 and nothing is bound
+static int localNode() {
+	return 0;
+}
+
+static int arenaNode(arena *a) {
+	return 0;
+}
+
+#ifdef MYMALLOC_THREADS
+static arena *nodeArena(int node, size_t index) {
+	return &arenas[index % NARENAS];
+}
+#endif
+
+static void bindNode(void *p, size_t size, int node) {
+}
+#endif
+
+// record the kind of mapping that starts at an aligned address in the segment map, mapping the leaf that covers it if needed
+// leaves are installed with a compare-and-swap, so arenas can map segments at the same time without a lock
+// return false if the leaf could not be mapped
+static bool markSegment(void *base, uint8_t kind) {
+	uintptr_t index = (uintptr_t) base >> SEGSHIFT;
+	uint8_t **top = &segmentMap[index >> MAPLEAFBITS];
+	uint8_t *leaf = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+	if (leaf == NULL) {
+		leaf = mmap(NULL, 1 << MAPLEAFBITS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (leaf == MAP_FAILED) {
+			return false;
+		}
+		uint8_t *expected = NULL;
+		if (!__atomic_compare_exchange_n(top, &expected, leaf, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			munmap(leaf, 1 << MAPLEAFBITS);
+			leaf = expected;
+		}
+	}
+	STORE(&leaf[index & ((1 << MAPLEAFBITS) - 1)], kind);
+	return true;
+}
+
+// get the kind of mapping that starts at the beginning of the piece of the address space that contains an address
+// the segment map is checked before anything is touched, so any address can be passed in, even one that is not mapped
+static uint8_t segmentKind(void *ptr) {
+	uintptr_t index = (uintptr_t) ptr >> SEGSHIFT;
+	if ((index >> MAPLEAFBITS) >= MAPTOP) {
+		return NOSEGMENT;
+	}
+	uint8_t *leaf = __atomic_load_n(&segmentMap[index >> MAPLEAFBITS], __ATOMIC_ACQUIRE);
+	if (leaf == NULL) {
+		return NOSEGMENT;
+	}
+	return LOAD(&leaf[index & ((1 << MAPLEAFBITS) - 1)]);
+}
+
+#ifdef MYMALLOC_GROWABLE
+// get the segment that contains an address by masking it, the address must be in a segment
+static reserved *segmentOf(void *ptr) {
+	return (reserved *) mapBase(ptr);
+}
+
+// get the arena that owns a segment
+static arena *segmentArena(reserved *res) {
+	return res->owner;
+}
+
+#if MYMALLOC_DIAGNOSTICS
+// get the chunk start bitmap of a segment
+static uint64_t *segmentStarts(reserved *res) {
+	return res->starts;
+}
+
+// find the segment that contains an address using the segment map, or return NULL if the address is not in any segment
+static reserved *findSegment(void *ptr) {
+	if (segmentKind(ptr) != HEAPSEGMENT) {
+		return NULL;
+	}
+	return segmentOf(ptr);
+}
+#endif
+#else
+// get the memory array that contains an address, the address must be in a memory array
+static reserved *segmentOf(void *ptr) {
+	return (reserved *) mem[((char *) ptr - (char *) mem) / MEMSIZE];
+}
+
+// get the arena that owns a memory array
+static arena *segmentArena(reserved *res) {
+	return &arenas[((char *) res - (char *) mem) / MEMSIZE];
+}
+
+#if MYMALLOC_DIAGNOSTICS
+// get the chunk start bitmap of a memory array, which is kept in its arena
+static uint64_t *segmentStarts(reserved *res) {
+	return segmentArena(res)->starts;
+}
+
+// find the memory array that contains an address, or return NULL if the address is not in any memory array
+static reserved *findSegment(void *ptr) {
+	char *memory = (char *) mem;
+	if ((char *) ptr < memory || (char *) ptr >= memory + sizeof(mem)) {
+		return NULL;
+	}
+	return segmentOf(ptr);
+}
+#endif
+#endif
+
+// check whether a segment is backed by a huge page, which only a growable segment of the huge page build can be
+static bool isHugeSegment(reserved *res) {
+#ifdef MYMALLOC_HUGEPAGES
+	return res->huge;
+#else
+	return false;
+#endif
+}
+
+#ifdef MYMALLOC_HARDENED
+// in the hardened build, the top 16 bits of dataSize hold a canary computed from the address of the chunk struct,
+// which is written with every data size, so a chunk struct that was overwritten almost never still holds the canary of its address
+// data sizes stay below 2^48 bytes, which is more than mmap can map
+#define CANARYBITS (~(size_t) 0 << 48)
+
+static size_t chunkCanary(chunk *c) {
+	return ((uintptr_t) c * 0x9e3779b97f4a7c15) & CANARYBITS;
+}
+
+// check whether the chunk struct at an address still holds its canary
+static bool isIntact(chunk *c) {
+	return (LOAD(&c->dataSize) & CANARYBITS) == chunkCanary(c);
+}
+#else
+#define CANARYBITS ((size_t) 0)
+
+static size_t chunkCanary(chunk *c) {
+	return 0;
+}
+#endif
+
+// compute the data size of a chunk without the status bits and the canary
+static size_t chunkSize(chunk *c) {
+	return LOAD(&c->dataSize) & ~(size_t) 7 & ~CANARYBITS;
+}
+
+// check whether a chunk is allocated (a chunk in a thread cache is still allocated)
+static bool isAllocated(chunk *c) {
+	return (LOAD(&c->dataSize) & ALLOCATED) != 0;
+}
+
+#if MYMALLOC_DIAGNOSTICS
+// check whether a chunk is in use by the user, which means allocated and not in a thread cache
+static bool isInUse(chunk *c) {
+	return (LOAD(&c->dataSize) & (ALLOCATED | CACHED)) == ALLOCATED;
+}
+#endif
+
+// check whether a chunk has a mapping of its own
+static bool isMapped(chunk *c) {
+	return (LOAD(&c->dataSize) & MAPPED) != 0;
+}
+
+// get the chunk that owns the data of a free block, and the free block that lives in the data of a chunk
+static chunk *blockChunk(freeBlock *block) {
+	return (chunk *) ((char *) block - sizeof(chunk));
+}
+
+static freeBlock *chunkBlock(chunk *c) {
+	return (freeBlock *) ((char *) c + sizeof(chunk));
+}
+
+// get the chunk that follows a chunk, or the end of the memory array if the chunk is the last chunk
+static chunk *nextChunk(chunk *c) {
+	return (chunk *) ((char *) c + sizeof(chunk) + chunkSize(c));
+}
+
+// get the chunk that precedes a chunk from its boundary tag, the chunk must not be the first chunk
+static chunk *prevChunk(chunk *c) {
+	return (chunk *) ((char *) c - c->prevSize - sizeof(chunk));
+}
+
+// set the data size, allocated bit and canary of a chunk and write the boundary tag into the chunk that follows it
+static void setChunk(reserved *res, chunk *c, size_t size, bool allocated) {
+	STORE(&c->dataSize, size | (allocated ? ALLOCATED : 0) | chunkCanary(c));
+	chunk *next = nextChunk(c);
+	if ((char *) next < (char *) res + SEGMENTSIZE) {
+		STORE(&next->prevSize, size);
+	}
+}
+
+#if MYMALLOC_DIAGNOSTICS
+// mark or unmark the start of a chunk in the chunk start bitmap
+static void markStart(reserved *res, chunk *c, bool isStart) {
+	uint64_t *starts = segmentStarts(res);
+	size_t word = ((char *) c - (char *) res) >> 3;
+	uint64_t bits = LOAD(&starts[word >> 6]);
+	if (isStart) {
+		bits |= (uint64_t) 1 << (word & 63);
+	} else {
+		bits &= ~((uint64_t) 1 << (word & 63));
+	}
+	STORE(&starts[word >> 6], bits);
+}
+
+// find the chunk that contains an address in a segment by searching the chunk start bitmap backwards
+// this is only used to report an error, so it is allowed to be slower than the rest of myfree
+static chunk *containingChunk(reserved *res, char *address) {
+	uint64_t *starts = segmentStarts(res);
+	size_t word = (address - (char *) res) >> 3;
+	size_t index = word >> 6;
+	uint64_t bits = LOAD(&starts[index]) & (~(uint64_t) 0 >> (63 - (word & 63)));
+	while (bits == 0) {
+		bits = LOAD(&starts[--index]);
+	}
+	return (chunk *) ((char *) res + (((index << 6) + 63 - __builtin_clzll(bits)) << 3));
+}
+#else
+// without diagnostics, pointers are not validated, so there is no chunk start bitmap to keep
+static void markStart(reserved *res, chunk *c, bool isStart) {
+}
+#endif
+
+// compute the bin of a data size
+static size_t binIndex(size_t size) {
+	if (size <= SMALLMAX) {
+		return (size >> 3) - 1;
+	}
+	// floor(log2(size - 1)) is 9 for size in (512, 1024], so subtract 9 to start counting at SMALLBINS
+	size_t index = SMALLBINS + (63 - __builtin_clzll((unsigned long long) (size - 1))) - 9;
+	return index < NBINS ? index : NBINS - 1;
+}
+
+// get the tree block that lives in the data of a free chunk in a power-of-two bin, and the chunk that owns a tree block
+static treeBlock *chunkTree(chunk *c) {
+	return (treeBlock *) ((char *) c + sizeof(chunk));
+}
+
+static chunk *treeChunk(treeBlock *t) {
+	return (chunk *) ((char *) t - sizeof(chunk));
+}
+
+// compute the priority of a tree block from its address with the finalizer of splitmix64, which spreads nearby addresses over all 64 bits,
+// so a tree is balanced like a treap with random priorities without keeping a priority or a random number generator
+static uint64_t treePriority(treeBlock *t) {
+	uint64_t x = (uintptr_t) t;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+#ifndef MYMALLOC_BESTFIT
+// in the first fit and next fit builds, the tree of a bin is in address order, so the lowest fitting block is found from maxSize
+static bool isBefore(treeBlock *x, treeBlock *y) {
+	return (uintptr_t) x < (uintptr_t) y;
+}
+#else
+// in the best fit build, the tree of a bin is in order of data size and then address, so the best fit is the first block that is big enough
+static bool isBefore(treeBlock *x, treeBlock *y) {
+	size_t xSize = chunkSize(treeChunk(x));
+	size_t ySize = chunkSize(treeChunk(y));
+	return xSize < ySize || (xSize == ySize && (uintptr_t) x < (uintptr_t) y);
+}
+#endif
+
+// recompute the largest data size in the subtree of a tree block from its own data size and its children
+static void updateMax(treeBlock *t) {
+	size_t max = chunkSize(treeChunk(t));
+	if (t->left != NULL && t->left->maxSize > max) {
+		max = t->left->maxSize;
+	}
+	if (t->right != NULL && t->right->maxSize > max) {
+		max = t->right->maxSize;
+	}
+	t->maxSize = max;
+}
+
+// rotate the left child of a tree block above it, or the right child of a tree block above it, and return the new root of the subtree
+// diagram: y(x(a, b), c) becomes x(a, y(b, c)) and back
+static treeBlock *rotateRight(treeBlock *y) {
+	treeBlock *x = y->left;
+	y->left = x->right;
+	x->right = y;
+	updateMax(y);
+	updateMax(x);
+	return x;
+}
+
+static treeBlock *rotateLeft(treeBlock *x) {
+	treeBlock *y = x->right;
+	x->right = y->left;
+	y->left = x;
+	updateMax(x);
+	updateMax(y);
+	return y;
+}
+
+// insert a tree block into a tree in its order and rotate it up while its priority is higher than its parent's, and return the new root
+// the depth of a treap is O(log n) in expectation, so the recursion is too
+static treeBlock *insertTree(treeBlock *root, treeBlock *t) {
+	if (root == NULL) {
+		t->left = NULL;
+		t->right = NULL;
+		t->maxSize = chunkSize(treeChunk(t));
+		return t;
+	}
+	if (isBefore(t, root)) {
+		root->left = insertTree(root->left, t);
+		if (treePriority(root->left) > treePriority(root)) {
+			return rotateRight(root);
+		}
+	} else {
+		root->right = insertTree(root->right, t);
+		if (treePriority(root->right) > treePriority(root)) {
+			return rotateLeft(root);
+		}
+	}
+	updateMax(root);
+	return root;
+}
+
+// join two trees, where every block of the first is before every block of the second, by keeping the root with the higher priority on top
+static treeBlock *joinTrees(treeBlock *x, treeBlock *y) {
+	if (x == NULL) {
+		return y;
+	}
+	if (y == NULL) {
+		return x;
+	}
+	if (treePriority(x) > treePriority(y)) {
+		x->right = joinTrees(x->right, y);
+		updateMax(x);
+		return x;
+	}
+	y->left = joinTrees(x, y->left);
+	updateMax(y);
+	return y;
+}
+
+// remove a tree block from a tree by finding it in its order and joining its children in its place, and return the new root
+static treeBlock *removeTree(treeBlock *root, treeBlock *t) {
+	if (root == t) {
+		return joinTrees(t->left, t->right);
+	}
+	if (isBefore(t, root)) {
+		root->left = removeTree(root->left, t);
+	} else {
+		root->right = removeTree(root->right, t);
+	}
+	updateMax(root);
+	return root;
+}
+
+// add a free chunk to the free block index of its arena
+// a chunk in an exact bin is linked at the head of its bin, and a chunk in a power-of-two bin is inserted into the tree of its bin
+static void insertFree(arena *a, chunk *c) {
+	size_t index = binIndex(chunkSize(c));
+	if (index < SMALLBINS) {
+		freeBlock *block = chunkBlock(c);
+		block->prevFree = NULL;
+		block->nextFree = a->bins[index];
+		if (block->nextFree != NULL) {
+			block->nextFree->prevFree = block;
+		}
+		a->bins[index] = block;
+	} else {
+		a->trees[index - SMALLBINS] = insertTree(a->trees[index - SMALLBINS], chunkTree(c));
+	}
+	a->binmap[index >> 6] |= (uint64_t) 1 << (index & 63);
+	a->stats.freeBytes += chunkSize(c);
+	a->stats.freeChunks++;
+}
+
+// remove a free chunk from the free block index of its arena, this must be done before the data size of the chunk changes
+static void removeFree(arena *a, chunk *c) {
+	size_t index = binIndex(chunkSize(c));
+	bool isEmpty;
+	if (index < SMALLBINS) {
+		freeBlock *block = chunkBlock(c);
+		if (block->prevFree != NULL) {
+			block->prevFree->nextFree = block->nextFree;
+		} else {
+			a->bins[index] = block->nextFree;
+		}
+		if (block->nextFree != NULL) {
+			block->nextFree->prevFree = block->prevFree;
+		}
+		isEmpty = a->bins[index] == NULL;
+	} else {
+		a->trees[index - SMALLBINS] = removeTree(a->trees[index - SMALLBINS], chunkTree(c));
+		isEmpty = a->trees[index - SMALLBINS] == NULL;
+	}
+	if (isEmpty) {
+		a->binmap[index >> 6] &= ~((uint64_t) 1 << (index & 63));
+	}
+	a->stats.freeBytes -= chunkSize(c);
+	a->stats.freeChunks--;
+}
+
+// find the first non-empty bin at or after index using the bitmap, or return NBINS if there is none
+static size_t nextNonEmptyBin(arena *a, size_t index) {
+	while (index < NBINS) {
+		uint64_t word = a->binmap[index >> 6] & (~(uint64_t) 0 << (index & 63));
+		if (word != 0) {
+			return (index & ~(size_t) 63) + __builtin_ctzll(word);
+		}
+		index = (index & ~(size_t) 63) + 64;
+	}
+	return NBINS;
+}
+
+#ifndef MYMALLOC_BESTFIT
+// find the lowest block of an address-ordered tree that can hold size bytes of data, or return NULL if no block is big enough
+// the left subtree is taken whenever its maxSize is big enough, so this follows one path down the tree
+static treeBlock *lowestFit(treeBlock *t, size_t size) {
+	if (t == NULL || t->maxSize < size) {
+		return NULL;
+	}
 	while (true) {
-		// if the ptr is at the start of the data, then free the chunk
-		if ((char *) currChunk + sizeof(chunk) == (char *) ptr) {
-			if (currChunk == res->firstChunk) {
-				res->firstChunk = currChunk->next;
-			} else {
-				prevChunk->next = currChunk->next;
-			}
-			return;
+		if (t->left != NULL && t->left->maxSize >= size) {
+			t = t->left;
+		} else if (chunkSize(treeChunk(t)) >= size) {
+			return t;
+		} else {
+			t = t->right;
 		}
-		// if the ptr is not at the start of the data and if it is in the range of the rest of the data, then print error and return
-		// example diagram where each hexadecimal represents 1 byte:
-		// prevChunk[0x5] data[0x6 0x7] currChunk[0x8] data[0x9 0xa]
-		// if ptr is 0x7, then it is not at the beginning of the data but it is in the range of the rest of the data, 
-		// so print error message using file and line number saying that the pointer is not at the start of the chunk
-		if ((char *) ptr > (char *) currChunk + sizeof(chunk) && (char *) ptr < (char *) currChunk + sizeof(chunk) + currChunk->dataSize) {
-			printf("Error at file %s at line %d: pointer %p is not at the start of the chunk\n", file, line, ptr);
-			return;
+	}
+}
+#endif
+
+#if defined(MYMALLOC_NEXTFIT)
+// find the lowest block of an address-ordered tree at or after an address that can hold size bytes of data, or return NULL if there is none
+// only one call to lowestFit on the way back up can find a block, and the others return right away, so this is O(log n) as well
+static treeBlock *fitFrom(treeBlock *t, char *from, size_t size) {
+	if (t == NULL || t->maxSize < size) {
+		return NULL;
+	}
+	if ((char *) t < from) {
+		return fitFrom(t->right, from, size);
+	}
+	treeBlock *found = fitFrom(t->left, from, size);
+	if (found == NULL && chunkSize(treeChunk(t)) >= size) {
+		found = t;
+	}
+	return found != NULL ? found : lowestFit(t->right, size);
+}
+
+// pick the lowest free block of a power-of-two bin that can hold size bytes of data at or after the rover, wrapping around to the lowest one
+// before the rover, and move the rover to it, or return NULL if no block in the bin is big enough (next fit)
+static treeBlock *fitBlock(arena *a, size_t index, size_t size) {
+	treeBlock *t = fitFrom(a->trees[index - SMALLBINS], a->rover, size);
+	if (t == NULL) {
+		t = lowestFit(a->trees[index - SMALLBINS], size);
+	}
+	if (t != NULL) {
+		a->rover = (char *) t;
+	}
+	return t;
+}
+#elif !defined(MYMALLOC_BESTFIT)
+// pick the lowest free block of a power-of-two bin that can hold size bytes of data, or return NULL if no block in the bin is big enough (first fit)
+static treeBlock *fitBlock(arena *a, size_t index, size_t size) {
+	return lowestFit(a->trees[index - SMALLBINS], size);
+}
+#else
+// pick the smallest free block of a power-of-two bin that can hold size bytes of data, the lowest one if there is a tie,
+// or return NULL if no block in the bin is big enough (best fit)
+// the tree is in order of data size, so this is the first block that is big enough, found on one path down the tree
+static treeBlock *fitBlock(arena *a, size_t index, size_t size) {
+	treeBlock *best = NULL;
+	for (treeBlock *t = a->trees[index - SMALLBINS]; t != NULL;) {
+		if (chunkSize(treeChunk(t)) >= size) {
+			best = t;
+			t = t->left;
+		} else {
+			t = t->right;
 		}
+	}
+	return best;
+}
+#endif
 
-		// if the ptr belongs to free space between the end of the previous chunk and the beginning of the next chunk, then print error and return
-		// example diagram where each hexadecimal represents 1 byte:
-		// prevChunk[0x5] data[0x6] free[0x7] currChunk[0x8] data[0x9]
-		// if ptr is 0x7, then it belongs to free space, so print error message using file and line number
-		// saying that the pointer has already been freed
-		if ((char *) ptr >= (char *) prevChunk + prevChunk->dataSize + sizeof(chunk) && (char *) ptr < (char *) currChunk) {
-			printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
-			return;
+// find a free chunk that can hold size bytes of data, or return NULL if there is none
+// the smallest non-empty bin that fits is used, and inside a power-of-two bin the fit policy picks the chunk
+static chunk *findFree(arena *a, size_t size) {
+	size_t index = nextNonEmptyBin(a, binIndex(size));
+	while (index < NBINS) {
+		// every chunk in an exact bin has the same data size, which is the smallest one that fits, so any of them is the best fit
+		if (index < SMALLBINS) {
+			return blockChunk(a->bins[index]);
 		}
-		// if current chunk is at the end of the memory array, then the pointer is not found, so break out of the loop
-		if ((char *) currChunk == (memory + MEMSIZE)) {
-			break;
+		treeBlock *t = fitBlock(a, index, size);
+		if (t != NULL) {
+			return treeChunk(t);
 		}
-		prevChunk = currChunk;
-		currChunk = currChunk->next;
+		index = nextNonEmptyBin(a, index + 1);
 	}
+	return NULL;
 }
-// check memory leaks
-size_t isMemoryLeaking() {
-	// if MEMSIZE is less than the size of the reserved struct + chunk struct + 8 bytes of data, or
-	// if MEMSIZE is not divisible by 8, then return false
-	if (MEMSIZE < sizeof(reserved) + sizeof(chunk) + 8 || ((size_t) MEMSIZE & 7) != 0) {
-		printf("Error: memory size is invalid\n");
+
+// get the first chunk of a segment, which starts right after the reserved struct and its padding
+static chunk *firstChunk(reserved *res) {
+	return (chunk *) ((char *) res + FIRSTCHUNK);
+}
+
+// turn a whole segment after the reserved struct into one free chunk of an arena
+static void formatSegment(arena *a, reserved *res) {
+	chunk *first = firstChunk(res);
+	setChunk(res, first, MAXDATA, false);
+	markStart(res, first, true);
+	insertFree(a, first);
+}
+
+#ifdef MYMALLOC_GROWABLE
+// enumeration for the number of bytes of its last segment that an arena may leave in use after every chunk in it is freed
+enum { TRIMTHRESHOLD = 128 * 1024 };
+
+// segments are mapped by allocChunk when they are needed, so there is nothing to set up
+static void initArena(arena *a) {
+}
+
+// map a new segment for an arena and add it to the free block index as one free chunk, or return false if mmap fails
+static bool addSegment(arena *a) {
+	bool huge;
+	reserved *res = (reserved *) mapSegment(&huge);
+	if (res == NULL) {
 		return false;
 	}
-	// cast memory array to a char pointer so that the pointer arithmetic uses bytes instead of doubles
-	char *memory = (char *) mem;
-	// if the first chunk is NULL or at the end of the memory array, then there are no memory leaks
-	// so return false otherwise return true
-	reserved *res = (reserved *) memory;
-	return !(res->firstChunk == NULL || (char *) res->firstChunk == (memory + MEMSIZE));
-	
+	bindNode(res, SEGMENTSIZE, arenaNode(a));
+	if (!markSegment(res, HEAPSEGMENT)) {
+		unmapSegment(res, huge);
+		return false;
+	}
+#ifdef MYMALLOC_HUGEPAGES
+	res->huge = huge;
+#endif
+	// link the segment at the head of the segment list of the arena
+	res->owner = a;
+	res->prevSegment = NULL;
+	res->nextSegment = a->segments;
+	if (a->segments != NULL) {
+		a->segments->prevSegment = res;
+	}
+	a->segments = res;
+	res->touched = FIRSTCHUNK + sizeof(chunk) + sizeof(treeBlock);
+	formatSegment(a, res);
+	return true;
+}
+
+// give a segment back to the OS once every chunk in it is free, which means it is one free chunk
+// the arena keeps its last segment so that a program that allocates and frees in a loop doesn't map and unmap a segment every time,
+// but if more than TRIMTHRESHOLD bytes of it have been touched, then those pages are dropped with madvise(MADV_DONTNEED)
+static void releaseSegment(arena *a, reserved *res) {
+	chunk *first = firstChunk(res);
+	if (a->segments != res || res->nextSegment != NULL) {
+		removeFree(a, first);
+		if (res->prevSegment != NULL) {
+			res->prevSegment->nextSegment = res->nextSegment;
+		} else {
+			a->segments = res->nextSegment;
+		}
+		if (res->nextSegment != NULL) {
+			res->nextSegment->prevSegment = res->prevSegment;
+		}
+		markSegment(res, FREEDSEGMENT);
+		unmapSegment(res, isHugeSegment(res));
+		return;
+	}
+	// dropping some of the pages of a segment backed by a huge page would split the huge page, so it is kept whole
+	if (res->touched > TRIMTHRESHOLD && !isHugeSegment(res)) {
+		// keep the page that holds the tree block of the first chunk, and drop every page after it up to where chunks have been carved
+		uintptr_t page = sysconf(_SC_PAGESIZE);
+		char *start = (char *) (((uintptr_t) chunkTree(first) + sizeof(treeBlock) + page - 1) & ~(page - 1));
+		madvise(start, (char *) res + res->touched - start, MADV_DONTNEED);
+		res->touched = start - (char *) res;
+	}
+}
+
+// remember how far into the segment chunks have been carved, including the chunk struct and tree block that follow an allocated chunk
+static void touchChunk(reserved *res, chunk *c) {
+	size_t touched = (char *) nextChunk(c) + sizeof(chunk) + sizeof(treeBlock) - (char *) res;
+	if (touched > SEGMENTSIZE) {
+		touched = SEGMENTSIZE;
+	}
+	if (touched > res->touched) {
+		res->touched = touched;
+	}
+}
+#else
+// turn the memory array of an arena into one free chunk if it has never been used
+// the first chunk has a data size of 0 only before that happens
+static void initArena(arena *a) {
+	reserved *res = (reserved *) mem[a - arenas];
+	if (LOAD(&firstChunk(res)->dataSize) == 0) {
+		formatSegment(a, res);
+	}
+}
+
+// a memory array is never trimmed, so there is nothing to remember
+static void touchChunk(reserved *res, chunk *c) {
+}
+#endif
+
+// free an allocated chunk and coalesce it with its free neighbors
+// in the growable build, a segment in which every chunk is free is given back to the OS
+static void freeChunk(arena *a, chunk *c) {
+	reserved *res = segmentOf(c);
+	STORE(&res->liveChunks, res->liveChunks - 1);
+	uncountLive(&a->stats, chunkSize(c), sizeof(chunk));
+	// coalesce the chunk with the next chunk if the next chunk is free
+	// diagram: chunk -> free next chunk -> ... becomes bigger free chunk -> ...
+	size_t size = chunkSize(c);
+	chunk *next = nextChunk(c);
+	if ((char *) next < (char *) res + SEGMENTSIZE && !isAllocated(next)) {
+		removeFree(a, next);
+		markStart(res, next, false);
+		size += sizeof(chunk) + chunkSize(next);
+	}
+	// coalesce the chunk with the previous chunk if the previous chunk is free, using the boundary tag to find it
+	// diagram: free previous chunk -> chunk -> ... becomes bigger free chunk -> ...
+	if (c != firstChunk(res) && !isAllocated(prevChunk(c))) {
+		chunk *prev = prevChunk(c);
+		removeFree(a, prev);
+		markStart(res, c, false);
+		size += sizeof(chunk) + chunkSize(prev);
+		c = prev;
+	}
+	setChunk(res, c, size, false);
+	insertFree(a, c);
+#ifdef MYMALLOC_GROWABLE
+	if (res->liveChunks == 0) {
+		releaseSegment(a, res);
+	}
+#endif
+}
+
+#ifdef MYMALLOC_DEFERRED
+// free an allocated chunk without coalescing it: push it onto the deferred list of its arena and mark it as cached,
+// so that it stays allocated to its neighbors and the heap, while myfree and myrealloc report it as freed like a chunk in a thread cache
+// it is taken out of the live counts of the stats right away, and is counted again only to be freed by coalesceDeferred
+static void deferChunk(arena *a, chunk *c) {
+	uncountLive(&a->stats, chunkSize(c), sizeof(chunk));
+	STORE(&c->dataSize, LOAD(&c->dataSize) | CACHED);
+	freeBlock *block = chunkBlock(c);
+	block->nextFree = a->deferred;
+	a->deferred = block;
+	a->deferredChunks++;
+}
+
+// take back the chunk that was deferred last if it can hold size bytes of data with too little left over to split off another chunk,
+// which is the common case of a program that frees and allocates the same size, or return NULL without looking any further
+static chunk *takeDeferred(arena *a, size_t size) {
+	if (a->deferred == NULL) {
+		return NULL;
+	}
+	chunk *c = blockChunk(a->deferred);
+	if (chunkSize(c) < size || chunkSize(c) - size >= sizeof(chunk) + MINDATA) {
+		return NULL;
+	}
+	a->deferred = a->deferred->nextFree;
+	a->deferredChunks--;
+	STORE(&c->dataSize, LOAD(&c->dataSize) & ~(size_t) CACHED);
+	countLive(&a->stats, chunkSize(c), sizeof(chunk));
+	return c;
+}
+
+// free every deferred chunk of an arena in one batch, which coalesces it with its free neighbors and puts it in its bin,
+// and return whether there was any
+static bool coalesceDeferred(arena *a) {
+	if (a->deferred == NULL) {
+		return false;
+	}
+	while (a->deferred != NULL) {
+		chunk *c = blockChunk(a->deferred);
+		a->deferred = a->deferred->nextFree;
+		STORE(&c->dataSize, LOAD(&c->dataSize) & ~(size_t) CACHED);
+		countLive(&a->stats, chunkSize(c), sizeof(chunk));
+		freeChunk(a, c);
+	}
+	a->deferredChunks = 0;
+	return true;
+}
+#else
+// without deferred coalescing, a chunk is coalesced as soon as it is freed, so there is never a deferred chunk
+static void deferChunk(arena *a, chunk *c) {
+	freeChunk(a, c);
+}
+
+static chunk *takeDeferred(arena *a, size_t size) {
+	return NULL;
+}
+
+static bool coalesceDeferred(arena *a) {
+	return false;
+}
+#endif
+
+// allocate a chunk with size bytes of data from the free block index, or return NULL if there is no free chunk big enough
+// in the deferred build, the chunk freed last is taken back when it fits, and the deferred chunks are coalesced when no free chunk is big enough
+// in the growable build, the arena maps a new segment when none of its segments has a free chunk big enough, even after that
+// size must already be a multiple of 8 and at least MINDATA
+static chunk *allocChunk(arena *a, size_t size) {
+	chunk *c = takeDeferred(a, size);
+	if (c != NULL) {
+		return c;
+	}
+	c = findFree(a, size);
+	if (c == NULL && coalesceDeferred(a)) {
+		c = findFree(a, size);
+	}
+#ifdef MYMALLOC_GROWABLE
+	if (c == NULL && addSegment(a)) {
+		c = findFree(a, size);
+	}
+#endif
+	if (c == NULL) {
+		return NULL;
+	}
+	reserved *res = segmentOf(c);
+	removeFree(a, c);
+	// if the rest of the free chunk can hold another chunk, then split it off as a new free chunk after the data
+	// diagram: chunk struct -> data -> chunk struct of the rest -> free data -> next chunk
+	size_t freeSize = chunkSize(c);
+	if (freeSize - size >= sizeof(chunk) + MINDATA) {
+		setChunk(res, c, size, true);
+		chunk *rest = nextChunk(c);
+		setChunk(res, rest, freeSize - size - sizeof(chunk), false);
+		markStart(res, rest, true);
+		insertFree(a, rest);
+	} else {
+		setChunk(res, c, freeSize, true);
+	}
+	STORE(&res->liveChunks, res->liveChunks + 1);
+	countLive(&a->stats, chunkSize(c), sizeof(chunk));
+	touchChunk(res, c);
+	return c;
+}
+
+// shrink an allocated chunk to size bytes of data if the rest can hold another chunk,
+// and free the rest as a new chunk, which coalesces it with the next chunk if that is free
+// diagram: chunk struct -> data -> chunk struct of the rest -> free data -> next chunk
+static void shrinkChunk(arena *a, chunk *c, size_t size) {
+	reserved *res = segmentOf(c);
+	size_t oldSize = chunkSize(c);
+	if (oldSize - size < sizeof(chunk) + MINDATA) {
+		return;
+	}
+	setChunk(res, c, size, true);
+	chunk *rest = nextChunk(c);
+	setChunk(res, rest, oldSize - size - sizeof(chunk), true);
+	markStart(res, rest, true);
+	STORE(&res->liveChunks, res->liveChunks + 1);
+	// the chunk is counted with its new size, and the rest is counted as live until freeChunk frees it
+	uncountLive(&a->stats, oldSize, sizeof(chunk));
+	countLive(&a->stats, size, sizeof(chunk));
+	countLive(&a->stats, chunkSize(rest), sizeof(chunk));
+	freeChunk(a, rest);
+}
+
+// grow an allocated chunk in place to size bytes of data by taking in the next chunk if it is free and big enough,
+// and give back what is left of it, or return false if the next chunk is allocated or too small
+static bool growChunk(arena *a, chunk *c, size_t size) {
+	reserved *res = segmentOf(c);
+	chunk *next = nextChunk(c);
+	if ((char *) next >= (char *) res + SEGMENTSIZE || isAllocated(next) || chunkSize(c) + sizeof(chunk) + chunkSize(next) < size) {
+		return false;
+	}
+	removeFree(a, next);
+	markStart(res, next, false);
+	uncountLive(&a->stats, chunkSize(c), sizeof(chunk));
+	setChunk(res, c, chunkSize(c) + sizeof(chunk) + chunkSize(next), true);
+	countLive(&a->stats, chunkSize(c), sizeof(chunk));
+	shrinkChunk(a, c, size);
+	raisePeaks(&a->stats);
+	touchChunk(res, c);
+	return true;
+}
+
+// compute the data size of a chunk that holds at least size bytes of data, so that its chunk struct and data add up to a multiple of the alignment,
+// which is the smallest multiple of 8 at least as large as size with the default alignment
+static size_t roundChunk(size_t size) {
+	return ((size + sizeof(chunk) + MYMALLOC_ALIGNMENT - 1) & ~(size_t) (MYMALLOC_ALIGNMENT - 1)) - sizeof(chunk);
+}
+
+// allocate a chunk with size bytes of data aligned to alignment, which is a power of two larger than MYMALLOC_ALIGNMENT, or return NULL
+// the chunk is allocated with enough room to move the data up to the alignment, then the part before the aligned data is split off and freed,
+// which needs room for a chunk struct and the smallest data, and the part after the data is given back by shrinkChunk
+// diagram: chunk struct -> free data -> chunk struct -> aligned data -> chunk struct of the rest -> free data -> next chunk
+static chunk *allocAlignedChunk(arena *a, size_t size, size_t alignment) {
+	if (size > MAXDATA - alignment - sizeof(chunk) - MINDATA - (MYMALLOC_ALIGNMENT - 8)) {
+		return NULL;
+	}
+	chunk *c = allocChunk(a, roundChunk(size + alignment + sizeof(chunk) + MINDATA));
+	if (c == NULL) {
+		return NULL;
+	}
+	reserved *res = segmentOf(c);
+	char *data = (char *) c + sizeof(chunk);
+	char *aligned = (char *) (((uintptr_t) data + alignment - 1) & ~(uintptr_t) (alignment - 1));
+	if (aligned != data) {
+		while ((size_t) (aligned - data) < sizeof(chunk) + MINDATA) {
+			aligned += alignment;
+		}
+		chunk *alignedChunk = (chunk *) (aligned - sizeof(chunk));
+		size_t total = chunkSize(c);
+		size_t frontSize = (char *) alignedChunk - data;
+		setChunk(res, c, frontSize, true);
+		setChunk(res, alignedChunk, total - frontSize - sizeof(chunk), true);
+		markStart(res, alignedChunk, true);
+		STORE(&res->liveChunks, res->liveChunks + 1);
+		uncountLive(&a->stats, total, sizeof(chunk));
+		countLive(&a->stats, frontSize, sizeof(chunk));
+		countLive(&a->stats, chunkSize(alignedChunk), sizeof(chunk));
+		freeChunk(a, c);
+		c = alignedChunk;
+	}
+	shrinkChunk(a, c, size);
+	return c;
+}
+
+// the number of chunks with a mapping of their own that have not been freed
+static size_t mappedChunks;
+#ifdef MYMALLOC_THREADS
+// chunks with a mapping of their own belong to no arena, so their stats have their own lock
+static heapStats mappedStats;
+static pthread_mutex_t mappedStatsLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// lock and get the stats that count the chunks with a mapping of their own
+// the single-threaded build counts them in its only arena, so that its high-water marks cover every block at once
+static heapStats *lockMappedStats() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_lock(&mappedStatsLock);
+	return &mappedStats;
+#else
+	return &arenas[0].stats;
+#endif
+}
+
+static void unlockMappedStats() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_unlock(&mappedStatsLock);
+#endif
+}
+
+// define mapping struct at the start of the mapping of a chunk that has a mapping of its own
+// mapSize is the size of the whole mapping and dataOffset is where the data starts, which is right after the mapping struct and chunk struct,
+// or further for an allocation with a larger alignment
+// diagram: mapping struct -> (alignment gap) -> chunk struct -> data -> end of mapping
+typedef struct mapping {
+	size_t mapSize;
+	size_t dataOffset;
+} mapping;
+
+// get the mapping of a chunk that has a mapping of its own, which starts at the beginning of the piece of the address space that contains it
+static mapping *mappingOf(chunk *c) {
+	return (mapping *) mapBase(c);
+}
+
+// compute the offset of the data in a mapping for an alignment, which must be a power of two,
+// which is the mapping struct and chunk struct rounded up to the alignment
+static size_t mappingOffset(size_t alignment) {
+	return (sizeof(mapping) + sizeof(chunk) + alignment - 1) & ~(alignment - 1);
+}
+
+// compute the size of a mapping that holds size bytes of data at dataOffset, rounded up to whole pages, or return 0 if it overflows
+// or if its data size doesn't fit in a chunk struct, which only happens in the compact build
+static size_t mappingSize(size_t size, size_t dataOffset) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	if (size > (size_t) (chunkWord) -1 - dataOffset - page) {
+		return 0;
+	}
+	return (dataOffset + size + page - 1) & ~(page - 1);
+}
+
+// write the mapping struct at the start of a mapping and the chunk struct right before its data, and return the chunk struct
+// a chunk with a mapping of its own has no previous chunk, and its data is the whole rest of the mapping
+static chunk *setMapping(mapping *m, size_t mapSize, size_t dataOffset) {
+	m->mapSize = mapSize;
+	STORE(&m->dataOffset, dataOffset);
+	chunk *c = (chunk *) ((char *) m + dataOffset - sizeof(chunk));
+	c->prevSize = 0;
+	STORE(&c->dataSize, (mapSize - dataOffset) | ALLOCATED | MAPPED | chunkCanary(c));
+	return c;
+}
+
+// map a chunk of its own with at least size bytes of data aligned to alignment, or return NULL if mmap fails
+// the mapping is aligned like a segment and recorded as a BIGSEGMENT in the segment map, so myfree finds its mapping struct by masking the pointer,
+// which is why the data must start in the first 2^SEGSHIFT bytes and the alignment must be smaller than that
+static chunk *mapChunk(size_t size, size_t alignment) {
+	if (alignment >= (size_t) 1 << SEGSHIFT) {
+		return NULL;
+	}
+	size_t dataOffset = mappingOffset(alignment);
+	size_t mapSize = mappingSize(size, dataOffset);
+	if (mapSize == 0) {
+		return NULL;
+	}
+	mapping *m = (mapping *) mapAligned(mapSize);
+	if (m == NULL) {
+		return NULL;
+	}
+	// a chunk with a mapping of its own belongs to no arena, so it goes on the node of the thread that allocates it
+	bindNode(m, mapSize, localNode());
+	if (!markSegment(m, BIGSEGMENT)) {
+		unmapAligned(m, mapSize);
+		return NULL;
+	}
+	__atomic_fetch_add(&mappedChunks, 1, __ATOMIC_RELAXED);
+	heapStats *stats = lockMappedStats();
+	countLive(stats, mapSize - dataOffset, dataOffset);
+	raisePeaks(stats);
+	unlockMappedStats();
+	return setMapping(m, mapSize, dataOffset);
+}
+
+// give the mapping of a chunk back to the OS in O(1)
+// the segment map is updated before munmap, so a new mapping at the same address can't be recorded first and then overwritten
+static void unmapChunk(chunk *c) {
+	mapping *m = mappingOf(c);
+	heapStats *stats = lockMappedStats();
+	uncountLive(stats, m->mapSize - m->dataOffset, m->dataOffset);
+	unlockMappedStats();
+	markSegment(m, FREEDSEGMENT);
+	unmapAligned(m, m->mapSize);
+	__atomic_fetch_sub(&mappedChunks, 1, __ATOMIC_RELAXED);
+}
+
+// count a chunk with a mapping of its own with its new data size after its mapping is resized
+static void resizeMappedStats(size_t oldSize, size_t size, size_t header) {
+	heapStats *stats = lockMappedStats();
+	uncountLive(stats, oldSize, header);
+	countLive(stats, size, header);
+	raisePeaks(stats);
+	unlockMappedStats();
+}
+
+// resize the mapping of a chunk to hold at least size bytes of data and return its chunk struct, or return NULL if it can't be resized
+// mremap first tries to grow or shrink the mapping where it is, and if the pages after it are taken,
+// then it moves the pages to a new aligned mapping, which changes the page tables instead of copying the data
+static chunk *remapChunk(chunk *c, size_t size) {
+	mapping *m = mappingOf(c);
+	size_t dataOffset = m->dataOffset;
+	size_t mapSize = mappingSize(size, dataOffset);
+	size_t oldSize = m->mapSize;
+	if (mapSize == 0) {
+		return NULL;
+	}
+	if (mapSize == oldSize) {
+		return c;
+	}
+	if (mremap(m, oldSize, mapSize, 0) != MAP_FAILED) {
+		if (mapSize > oldSize) {
+			addMappedBytes(mapSize - oldSize);
+		} else {
+			__atomic_fetch_sub(&mappedBytes, oldSize - mapSize, __ATOMIC_RELAXED);
+		}
+		resizeMappedStats(oldSize - dataOffset, mapSize - dataOffset, dataOffset);
+		return setMapping(m, mapSize, dataOffset);
+	}
+	mapping *moved = (mapping *) mapAligned(mapSize);
+	if (moved == NULL) {
+		return NULL;
+	}
+	if (!markSegment(moved, BIGSEGMENT)) {
+		unmapAligned(moved, mapSize);
+		return NULL;
+	}
+	// the old address is recorded as freed before its pages move away, for the same reason as in unmapChunk
+	markSegment(m, FREEDSEGMENT);
+	if (mremap(m, oldSize, mapSize, MREMAP_MAYMOVE | MREMAP_FIXED, moved) == MAP_FAILED) {
+		markSegment(m, BIGSEGMENT);
+		markSegment(moved, NOSEGMENT);
+		unmapAligned(moved, mapSize);
+		return NULL;
+	}
+	// the old pages are now part of the new mapping, which mapAligned has already counted
+	__atomic_fetch_sub(&mappedBytes, oldSize, __ATOMIC_RELAXED);
+	resizeMappedStats(oldSize - dataOffset, mapSize - dataOffset, dataOffset);
+	return setMapping(moved, mapSize, dataOffset);
+}
+
+// get the slab that contains an address and the slab segment that contains a slab
+static slab *slabOf(void *ptr) {
+	return (slab *) ((uintptr_t) ptr & ~(uintptr_t) (SLABSIZE - 1));
+}
+
+static slabSegment *slabSegmentOf(void *ptr) {
+	return (slabSegment *) mapBase(ptr);
+}
+
+// compute the size class of a slot size, which is at most 128
+static size_t slabClass(size_t size) {
+	return (size - MINDATA) >> 3;
+}
+
+// compute the number of slots of a slot size that fit in a slab after the slab struct
+static size_t slabSlots(size_t size) {
+	return (SLABSIZE - SLABHEADER) / size;
+}
+
+// link a slab at the head of a slab list, and unlink a slab from a slab list
+static void pushSlab(slab **list, slab *s) {
+	s->prevSlab = NULL;
+	s->nextSlab = *list;
+	if (*list != NULL) {
+		(*list)->prevSlab = s;
+	}
+	*list = s;
+}
+
+static void unlinkSlab(slab **list, slab *s) {
+	if (s->prevSlab != NULL) {
+		s->prevSlab->nextSlab = s->nextSlab;
+	} else {
+		*list = s->nextSlab;
+	}
+	if (s->nextSlab != NULL) {
+		s->nextSlab->prevSlab = s->prevSlab;
+	}
+}
+
+// map a new slab segment for an arena and link it at the head of its slab segment list, or return false if mmap fails
+static bool addSlabSegment(arena *a) {
+	bool huge;
+	slabSegment *seg = (slabSegment *) mapSegment(&huge);
+	if (seg == NULL) {
+		return false;
+	}
+	bindNode(seg, (size_t) 1 << SEGSHIFT, arenaNode(a));
+	if (!markSegment(seg, SLABSEGMENT)) {
+		unmapSegment(seg, huge);
+		return false;
+	}
+#ifdef MYMALLOC_HUGEPAGES
+	seg->huge = huge;
+#endif
+	seg->owner = a;
+	seg->carved = 1;
+	seg->prevSegment = NULL;
+	seg->nextSegment = a->slabSegments;
+	if (a->slabSegments != NULL) {
+		a->slabSegments->prevSegment = seg;
+	}
+	a->slabSegments = seg;
+	return true;
+}
+
+// give a slab segment back to the OS once it has no allocated slots, which means every slab carved from it is in the empty list
+// the arena keeps its last slab segment so that a program that allocates and frees in a loop doesn't map and unmap a slab segment every time
+static void releaseSlabSegment(arena *a, slabSegment *seg) {
+	if (a->slabSegments == seg && seg->nextSegment == NULL) {
+		return;
+	}
+	for (size_t page = 1; page < seg->carved; page++) {
+		unlinkSlab(&a->emptySlabs, (slab *) ((char *) seg + page * SLABSIZE));
+	}
+	if (seg->prevSegment != NULL) {
+		seg->prevSegment->nextSegment = seg->nextSegment;
+	} else {
+		a->slabSegments = seg->nextSegment;
+	}
+	if (seg->nextSegment != NULL) {
+		seg->nextSegment->prevSegment = seg->prevSegment;
+	}
+	a->stats.slabs -= seg->carved - 1;
+	markSegment(seg, FREEDSEGMENT);
+#ifdef MYMALLOC_HUGEPAGES
+	unmapSegment(seg, seg->huge);
+#else
+	unmapSegment(seg, false);
+#endif
+}
+
+// set up a slab for a slot size and link it into the list of its size class, or return NULL if a slab segment can't be mapped
+// an empty slab is reused first, then a new page is carved from the newest slab segment, and then a new slab segment is mapped
+static slab *newSlab(arena *a, size_t size) {
+	slab *s = a->emptySlabs;
+	if (s != NULL) {
+		unlinkSlab(&a->emptySlabs, s);
+	} else {
+		if (a->slabSegments == NULL || a->slabSegments->carved == SLABPAGES) {
+			if (!addSlabSegment(a)) {
+				return NULL;
+			}
+		}
+		s = (slab *) ((char *) a->slabSegments + a->slabSegments->carved * SLABSIZE);
+		a->slabSegments->carved++;
+		a->stats.slabs++;
+	}
+	// clear the bits of the slots and set the bits past the last slot
+	size_t slots = slabSlots(size);
+	for (size_t word = 0; word < SLABWORDS; word++) {
+		uint64_t used = 0;
+		if (slots <= word * 64) {
+			used = ~(uint64_t) 0;
+		} else if (slots < (word + 1) * 64) {
+			used = ~(uint64_t) 0 << (slots - word * 64);
+		}
+		STORE(&s->used[word], used);
+		STORE(&s->cached[word], 0);
+	}
+	STORE(&s->slotSize, size);
+	s->freeSlots = slots;
+	pushSlab(&a->partialSlabs[slabClass(size)], s);
+	return s;
+}
+
+// allocate a slot of a slot size from an arena, or return NULL if a slab segment can't be mapped
+// the first clear bit of the occupancy bitmap is found with ctz, and a slab that becomes full leaves the list of its size class
+static void *allocSlot(arena *a, size_t size) {
+	slab *s = a->partialSlabs[slabClass(size)];
+	if (s == NULL) {
+		s = newSlab(a, size);
+		if (s == NULL) {
+			return NULL;
+		}
+	}
+	size_t word = 0;
+	while (~s->used[word] == 0) {
+		word++;
+	}
+	size_t bit = __builtin_ctzll(~s->used[word]);
+	STORE(&s->used[word], s->used[word] | ((uint64_t) 1 << bit));
+	s->freeSlots--;
+	if (s->freeSlots == 0) {
+		unlinkSlab(&a->partialSlabs[slabClass(size)], s);
+	}
+	slabSegmentOf(s)->liveSlots++;
+	countLive(&a->stats, size, 0);
+	return (char *) s + SLABHEADER + (word * 64 + bit) * size;
+}
+
+// free a slot into its slab
+// a full slab goes back into the list of its size class, and an empty slab moves to the empty list, so any size class can reuse it
+static void freeSlot(arena *a, void *ptr) {
+	slab *s = slabOf(ptr);
+	size_t index = ((char *) ptr - (char *) s - SLABHEADER) / s->slotSize;
+	STORE(&s->used[index >> 6], s->used[index >> 6] & ~((uint64_t) 1 << (index & 63)));
+	if (s->freeSlots == 0) {
+		pushSlab(&a->partialSlabs[slabClass(s->slotSize)], s);
+	}
+	s->freeSlots++;
+	if (s->freeSlots == slabSlots(s->slotSize)) {
+		unlinkSlab(&a->partialSlabs[slabClass(s->slotSize)], s);
+		pushSlab(&a->emptySlabs, s);
+	}
+	uncountLive(&a->stats, s->slotSize, 0);
+	slabSegment *seg = slabSegmentOf(s);
+	seg->liveSlots--;
+	if (seg->liveSlots == 0) {
+		releaseSlabSegment(a, seg);
+	}
+}
+
+// allocate size bytes of data aligned to alignment from an arena, from a slab if size is at most MYMALLOC_SLABMAX and from a chunk otherwise,
+// or return NULL
+// size must already be rounded by roundSize, and larger than MYMALLOC_SLABMAX if alignment is larger than MYMALLOC_ALIGNMENT
+static void *arenaMalloc(arena *a, size_t size, size_t alignment) {
+	void *ptr;
+	if (size <= MYMALLOC_SLABMAX) {
+		ptr = allocSlot(a, size);
+	} else {
+		chunk *c;
+		if (alignment > MYMALLOC_ALIGNMENT) {
+			c = allocAlignedChunk(a, size, alignment);
+		} else {
+			c = allocChunk(a, size);
+		}
+		ptr = c == NULL ? NULL : (void *) ((char *) c + sizeof(chunk));
+	}
+	raisePeaks(&a->stats);
+	return ptr;
+}
+
+// get the arena that owns a slot or the data of a chunk of a data size
+// every chunk in use has more than MYMALLOC_SLABMAX bytes of data, so the data size tells slots and chunks apart
+static arena *ownerArena(void *ptr, size_t size) {
+	if (size <= MYMALLOC_SLABMAX) {
+		return slabSegmentOf(ptr)->owner;
+	}
+	return segmentArena(segmentOf(ptr));
+}
+
+// free a slot or the data of a chunk of a data size into the arena that owns it
+static void arenaFree(arena *a, void *ptr, size_t size) {
+	if (size <= MYMALLOC_SLABMAX) {
+		freeSlot(a, ptr);
+	} else {
+		deferChunk(a, (chunk *) ((char *) ptr - sizeof(chunk)));
+	}
+}
+
+#ifdef MYMALLOC_THREADS
+// the thread-safe build gives every thread an arena and puts a thread cache in front of the arenas
+// enumeration for the thread caches
+// data sizes from MINDATA to TCACHEMAX in 8-byte steps each have a cache bin, which is a singly linked list of cached chunks
+// a cache bin that runs empty is refilled with TCACHEBATCH chunks under one lock acquisition,
+// and a cache bin that reaches TCACHECOUNT chunks gives TCACHEBATCH of them back to their arenas
+// in the NUMA build, a thread gives the slots and chunks it frees from another node back in batches of REMOTEBATCH
+enum {
+	TCACHEMAX = 256,
+	TCACHEBINS = (TCACHEMAX - MINDATA) / 8 + 1,
+	TCACHECOUNT = 16,
+	TCACHEBATCH = 8,
+	REMOTEBATCH = 32
+};
+// define tcache struct containing the cache bins of one thread
+// counts and cachedChunks are read by mymalloc_stats and isMemoryLeaking from other threads, and the caches of all threads are linked so they can find them
+// in the NUMA build, remote holds the slots and chunks of other nodes that the thread has freed and remoteSizes their data sizes,
+// which count as cached until they are given back, and localFrees and remoteFrees count the frees of the thread by where their memory is
+typedef struct tcache {
+	freeBlock *bins[TCACHEBINS];
+	size_t counts[TCACHEBINS];
+	size_t cachedChunks;
+#ifdef MYMALLOC_NUMA
+	void *remote[REMOTEBATCH];
+	size_t remoteSizes[REMOTEBATCH];
+	size_t remoteCount;
+	size_t localFrees;
+	size_t remoteFrees;
+#endif
+	bool registered;
+	struct tcache *nextCache;
+	struct tcache *prevCache;
+} tcache;
+// every thread has its own cache and its own arena, so they are found without a lock
+// cacheLock protects the list of caches, and nextArena counts the arenas handed out in round-robin order
+static __thread tcache threadCache;
+static __thread arena *threadArena;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t regionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cacheKey;
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT;
+static tcache *caches;
+static size_t nextArena;
+
+static void lockArena(arena *a) {
+	pthread_mutex_lock(&a->lock);
+}
+
+static void unlockArena(arena *a) {
+	pthread_mutex_unlock(&a->lock);
+}
+
+static void drainRemote(arena *a);
+
+// lock the arena of the calling thread, give it back the slots and chunks that other threads have freed into its remote queue, and return it
+// a thread starts on the arena of the CPU it runs on (or the next arena in round-robin order if the CPU is unknown)
+// if another thread holds the lock, then the thread moves to the next arena in round-robin order instead of waiting in line,
+// so threads spread out over the arenas as soon as they contend
+// in the NUMA build, both only pick among the arenas of the node the thread runs on
+static arena *lockThreadArena() {
+	if (threadArena == NULL) {
+		int cpu = sched_getcpu();
+		size_t index = cpu >= 0 ? (size_t) cpu : __atomic_fetch_add(&nextArena, 1, __ATOMIC_RELAXED);
+		threadArena = nodeArena(localNode(), index);
+	}
+	if (pthread_mutex_trylock(&threadArena->lock) != 0) {
+		threadArena = nodeArena(localNode(), __atomic_fetch_add(&nextArena, 1, __ATOMIC_RELAXED));
+		lockArena(threadArena);
+	}
+	drainRemote(threadArena);
+	return threadArena;
+}
+
+// compute the cache bin of a data size that is at most TCACHEMAX
+static size_t cacheBin(size_t size) {
+	return (size - MINDATA) >> 3;
+}
+
+// mark a slot or the data of a chunk of a data size as cached or in use
+// the cached bits of a slab are shared by the slots that different threads cache, so they are changed with atomic operations
+static void setCached(void *ptr, size_t size, bool cached) {
+	if (size <= MYMALLOC_SLABMAX) {
+		slab *s = slabOf(ptr);
+		size_t index = ((char *) ptr - (char *) s - SLABHEADER) / size;
+		if (cached) {
+			__atomic_fetch_or(&s->cached[index >> 6], (uint64_t) 1 << (index & 63), __ATOMIC_RELAXED);
+		} else {
+			__atomic_fetch_and(&s->cached[index >> 6], ~((uint64_t) 1 << (index & 63)), __ATOMIC_RELAXED);
+		}
+		return;
+	}
+	chunk *c = (chunk *) ((char *) ptr - sizeof(chunk));
+	if (cached) {
+		STORE(&c->dataSize, LOAD(&c->dataSize) | CACHED);
+	} else {
+		STORE(&c->dataSize, LOAD(&c->dataSize) & ~(size_t) CACHED);
+	}
+}
+
+// free a slot or the data of a chunk of a data size into the remote queue of the arena that owns it and return true,
+// unless that is the arena of the calling thread, which frees it like before and gets false
+// the slot or chunk is marked as cached and pushed with one compare-and-swap and no lock, so a thread that frees what another thread allocated
+// never waits for the lock of the owner, which gives it back with its next allocation
+// a failed compare-and-swap means that another thread pushed first, so it is tried again with the new head
+// without remote queues (-DMYMALLOC_NOREMOTEQUEUE), every slot and chunk gets false and goes back under the lock of its arena
+static bool queueRemote(arena *a, void *ptr, size_t size) {
+#ifdef MYMALLOC_NOREMOTEQUEUE
+	return false;
+#else
+	if (a == threadArena) {
+		return false;
+	}
+	setCached(ptr, size, true);
+	freeBlock *b = (freeBlock *) ptr;
+	freeBlock *head = LOAD(&a->remoteQueue);
+	do {
+		b->nextFree = head;
+	} while (!__atomic_compare_exchange_n(&a->remoteQueue, &head, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return true;
+#endif
+}
+
+// give every slot and chunk in the remote queue of an arena back to the arena, whose lock must be held
+// the whole queue is taken with one exchange, so the lock holder is its only reader and the pushes after it start a new queue
+// every path that locks an arena to allocate or free drains it, and so do the fallback over all arenas, mymalloc_trim,
+// mymalloc_stats and isMemoryLeaking, but a queue of an arena that no thread locks again keeps its blocks until one of those runs
+// the queue doesn't keep data sizes, so a slot gets the size of its slab and a chunk the size in its chunk struct
+static void drainRemote(arena *a) {
+	if (LOAD(&a->remoteQueue) == NULL) {
+		return;
+	}
+	freeBlock *b = __atomic_exchange_n(&a->remoteQueue, NULL, __ATOMIC_ACQUIRE);
+	while (b != NULL) {
+		freeBlock *next = b->nextFree;
+		size_t size = segmentKind(b) == SLABSEGMENT ? slabOf(b)->slotSize : chunkSize((chunk *) ((char *) b - sizeof(chunk)));
+		setCached(b, size, false);
+		arenaFree(a, b, size);
+		b = next;
+	}
+}
+
+// push a slot or the data of a chunk of a data size onto a cache bin and mark it as cached
+static void pushCache(tcache *tc, void *ptr, size_t size) {
+	size_t bin = cacheBin(size);
+	setCached(ptr, size, true);
+	((freeBlock *) ptr)->nextFree = tc->bins[bin];
+	tc->bins[bin] = (freeBlock *) ptr;
+	STORE(&tc->counts[bin], tc->counts[bin] + 1);
+	STORE(&tc->cachedChunks, tc->cachedChunks + 1);
+}
+
+// pop a slot or the data of a chunk from a cache bin and mark it as in use, the cache bin must not be empty
+static void *popCache(tcache *tc, size_t bin) {
+	void *ptr = tc->bins[bin];
+	tc->bins[bin] = tc->bins[bin]->nextFree;
+	STORE(&tc->counts[bin], tc->counts[bin] - 1);
+	STORE(&tc->cachedChunks, tc->cachedChunks - 1);
+	setCached(ptr, (bin << 3) + MINDATA, false);
+	return ptr;
+}
+
+// give slots or chunks of a cache bin back to the heap until keep of them are left
+// a cached slot or chunk may have been allocated from another arena (a remote free), so every one goes back to the arena that owns it:
+// the ones of the arena of the thread under its lock, and the others through the remote queues of their arenas
+static void flushCache(tcache *tc, size_t bin, size_t keep) {
+	size_t size = (bin << 3) + MINDATA;
+	arena *locked = NULL;
+	while (tc->counts[bin] > keep) {
+		void *ptr = popCache(tc, bin);
+		arena *a = ownerArena(ptr, size);
+		if (queueRemote(a, ptr, size)) {
+			continue;
+		}
+		if (a != locked) {
+			if (locked != NULL) {
+				unlockArena(locked);
+			}
+			lockArena(a);
+			drainRemote(a);
+			locked = a;
+		}
+		arenaFree(a, ptr, size);
+	}
+	if (locked != NULL) {
+		unlockArena(locked);
+	}
+}
+
+#ifdef MYMALLOC_NUMA
+// the frees of the threads that have exited, which are kept under cacheLock so that mymalloc_stats still counts them
+static size_t exitedLocalFrees;
+static size_t exitedRemoteFrees;
+
+// give the slots and chunks of the remote buffer of a cache back to the arenas that own them,
+// taking the lock of each arena once and giving it every slot and chunk it owns before moving on to the next arena
+static void flushRemote(tcache *tc) {
+	while (tc->remoteCount > 0) {
+		arena *a = ownerArena(tc->remote[0], tc->remoteSizes[0]);
+		size_t kept = 0;
+		lockArena(a);
+		drainRemote(a);
+		for (size_t i = 0; i < tc->remoteCount; i++) {
+			void *ptr = tc->remote[i];
+			size_t size = tc->remoteSizes[i];
+			if (ownerArena(ptr, size) != a) {
+				tc->remote[kept] = ptr;
+				STORE(&tc->remoteSizes[kept], size);
+				kept++;
+				continue;
+			}
+			setCached(ptr, size, false);
+			arenaFree(a, ptr, size);
+		}
+		unlockArena(a);
+		STORE(&tc->cachedChunks, tc->cachedChunks - (tc->remoteCount - kept));
+		STORE(&tc->remoteCount, kept);
+	}
+}
+#endif
+
+// give every cached chunk of the thread back to the heap and unlink its cache when the thread exits
+static void destroyCache(void *arg) {
+	tcache *tc = (tcache *) arg;
+	for (size_t bin = 0; bin < TCACHEBINS; bin++) {
+		flushCache(tc, bin, 0);
+	}
+#ifdef MYMALLOC_NUMA
+	flushRemote(tc);
+#endif
+	pthread_mutex_lock(&cacheLock);
+#ifdef MYMALLOC_NUMA
+	// the frees of the thread are moved to the counts of the exited threads while no one can read them
+	exitedLocalFrees += tc->localFrees;
+	exitedRemoteFrees += tc->remoteFrees;
+	STORE(&tc->localFrees, 0);
+	STORE(&tc->remoteFrees, 0);
+#endif
+	if (tc->prevCache != NULL) {
+		tc->prevCache->nextCache = tc->nextCache;
+	} else {
+		caches = tc->nextCache;
+	}
+	if (tc->nextCache != NULL) {
+		tc->nextCache->prevCache = tc->prevCache;
+	}
+	tc->registered = false;
+	pthread_mutex_unlock(&cacheLock);
+}
+
+static void createCacheKey() {
+	pthread_key_create(&cacheKey, destroyCache);
+}
+
+// get the cache of the calling thread, linking it into the list of caches and registering its destructor on first use
+// the cache is marked as registered before its destructor is, because pthread_setspecific may call calloc,
+// which comes back here when the allocator replaces the C library's and must find the cache ready
+static tcache *getCache() {
+	tcache *tc = &threadCache;
+	if (!tc->registered) {
+		tc->registered = true;
+		pthread_mutex_lock(&cacheLock);
+		tc->prevCache = NULL;
+		tc->nextCache = caches;
+		if (caches != NULL) {
+			caches->prevCache = tc;
+		}
+		caches = tc;
+		pthread_mutex_unlock(&cacheLock);
+		pthread_once(&cacheKeyOnce, createCacheKey);
+		pthread_setspecific(cacheKey, tc);
+	}
+	return tc;
+}
+
+// allocate a slot or chunk of at most TCACHEMAX bytes of data from the cache of the calling thread and return its data
+// if the cache bin is empty, then refill it with up to TCACHEBATCH slots or chunks from the arena of the thread under one lock acquisition
+// return NULL if the arena has no free slot or chunk of that size either
+static void *cacheMalloc(size_t size) {
+	tcache *tc = getCache();
+	size_t bin = cacheBin(size);
+	if (tc->counts[bin] == 0) {
+		arena *a = lockThreadArena();
+		initArena(a);
+		for (int i = 0; i < TCACHEBATCH; i++) {
+			if (size <= MYMALLOC_SLABMAX) {
+				void *ptr = allocSlot(a, size);
+				if (ptr == NULL) {
+					break;
+				}
+				pushCache(tc, ptr, size);
+				continue;
+			}
+			chunk *c = allocChunk(a, size);
+			if (c == NULL) {
+				break;
+			}
+			// a chunk can be a little larger than size when the rest was too small to split off, so it goes to the bin of its own size
+			// if that is larger than TCACHEMAX, then it can't be cached, so give it back and stop refilling
+			if (chunkSize(c) > TCACHEMAX) {
+				freeChunk(a, c);
+				break;
+			}
+			pushCache(tc, (char *) c + sizeof(chunk), chunkSize(c));
+		}
+		raisePeaks(&a->stats);
+		unlockArena(a);
+	}
+	if (tc->counts[bin] == 0) {
+		return NULL;
+	}
+	return popCache(tc, bin);
+}
+
+// free a slot or the data of a chunk of a data size of at most TCACHEMAX bytes into the cache of the calling thread
+// if the cache bin is full, then give TCACHEBATCH slots or chunks back to their arenas
+static void cacheFree(void *ptr, size_t size) {
+	tcache *tc = getCache();
+	pushCache(tc, ptr, size);
+	size_t bin = cacheBin(size);
+	if (tc->counts[bin] >= TCACHECOUNT) {
+		flushCache(tc, bin, TCACHECOUNT - TCACHEBATCH);
+	}
+}
+
+#ifdef MYMALLOC_NUMA
+// count a free of the calling thread as local or remote, and if the slot or chunk belongs to an arena of another node,
+// then put it in the remote buffer of the thread and mark it as cached, give the buffer back once it is full, and return true
+// a free of local memory returns false and goes on like in the thread-safe build, so memory of another node is never cached for reuse here
+static bool remoteFree(void *ptr, size_t size) {
+	tcache *tc = getCache();
+	if (arenaNode(ownerArena(ptr, size)) == localNode()) {
+		STORE(&tc->localFrees, tc->localFrees + 1);
+		return false;
+	}
+	STORE(&tc->remoteFrees, tc->remoteFrees + 1);
+	setCached(ptr, size, true);
+	tc->remote[tc->remoteCount] = ptr;
+	STORE(&tc->remoteSizes[tc->remoteCount], size);
+	STORE(&tc->remoteCount, tc->remoteCount + 1);
+	STORE(&tc->cachedChunks, tc->cachedChunks + 1);
+	if (tc->remoteCount == REMOTEBATCH) {
+		flushRemote(tc);
+	}
+	return true;
+}
+
+// add the number of nodes and the local and remote frees of every thread, including the threads that have exited, to stats
+static void countNodeFrees(mystats *stats) {
+	stats->nodes = numaNodes;
+	pthread_mutex_lock(&cacheLock);
+	stats->localFrees = exitedLocalFrees;
+	stats->remoteFrees = exitedRemoteFrees;
+	for (tcache *tc = caches; tc != NULL; tc = tc->nextCache) {
+		stats->localFrees += LOAD(&tc->localFrees);
+		stats->remoteFrees += LOAD(&tc->remoteFrees);
+	}
+	pthread_mutex_unlock(&cacheLock);
+}
+#endif
+
+// give every chunk in the cache of the calling thread back to the heap, no arena lock may be held
+// this is done before mymalloc gives up, so that chunks hoarded by the cache can be coalesced and used for the allocation
+static void flushThreadCache() {
+	if (threadCache.registered) {
+		for (size_t bin = 0; bin < TCACHEBINS; bin++) {
+			flushCache(&threadCache, bin, 0);
+		}
+#ifdef MYMALLOC_NUMA
+		flushRemote(&threadCache);
+#endif
+	}
+}
+
+// count the slots and chunks that are in the caches of all threads
+static size_t countCachedChunks() {
+	size_t count = 0;
+	pthread_mutex_lock(&cacheLock);
+	for (tcache *tc = caches; tc != NULL; tc = tc->nextCache) {
+		count += LOAD(&tc->cachedChunks);
+	}
+	pthread_mutex_unlock(&cacheLock);
+	return count;
+}
+
+// subtract a count from a total, stopping at 0
+static size_t subtractCount(size_t total, size_t count) {
+	return count < total ? total - count : 0;
+}
+
+// take count slots or chunks of a data size out of the live counts of stats
+static void uncountBlocks(mystats *stats, size_t count, size_t size) {
+	size_t header = size > MYMALLOC_SLABMAX ? sizeof(chunk) : 0;
+	stats->liveBlocks = subtractCount(stats->liveBlocks, count);
+	stats->sizeClasses[statClass(size)] = subtractCount(stats->sizeClasses[statClass(size)], count);
+	stats->liveBytes = subtractCount(stats->liveBytes, count * size);
+	stats->headerBytes = subtractCount(stats->headerBytes, count * header);
+}
+
+// take the slots and chunks that are in the caches of all threads out of the live counts of stats,
+// since the users have freed them even though their arenas still count them as allocated
+// the caches change while they are read, so a count that would go below 0 stops at 0
+static void uncountCached(mystats *stats) {
+	pthread_mutex_lock(&cacheLock);
+	for (tcache *tc = caches; tc != NULL; tc = tc->nextCache) {
+		for (size_t bin = 0; bin < TCACHEBINS; bin++) {
+			uncountBlocks(stats, LOAD(&tc->counts[bin]), (bin << 3) + MINDATA);
+		}
+#ifdef MYMALLOC_NUMA
+		size_t remoteCount = LOAD(&tc->remoteCount);
+		for (size_t i = 0; i < remoteCount && i < REMOTEBATCH; i++) {
+			uncountBlocks(stats, 1, LOAD(&tc->remoteSizes[i]));
+		}
+#endif
+	}
+	pthread_mutex_unlock(&cacheLock);
+}
+
+// lock and unlock the list of regions
+static void lockRegions() {
+	pthread_mutex_lock(&regionLock);
+}
+
+static void unlockRegions() {
+	pthread_mutex_unlock(&regionLock);
+}
+#else
+// the single-threaded build has no thread caches and no locks, and every allocation comes from the first arena
+enum { TCACHEMAX = 0 };
+
+static void lockArena(arena *a) {
+}
+
+static void unlockArena(arena *a) {
+}
+
+static arena *lockThreadArena() {
+	return &arenas[0];
+}
+
+static bool queueRemote(arena *a, void *ptr, size_t size) {
+	return false;
+}
+
+static void drainRemote(arena *a) {
+}
+
+static void *cacheMalloc(size_t size) {
+	return NULL;
+}
+
+static void cacheFree(void *ptr, size_t size) {
+}
+
+static void flushThreadCache() {
+}
+
+static size_t countCachedChunks() {
+	return 0;
+}
+
+static void uncountCached(mystats *stats) {
+}
+
+static void lockRegions() {
+}
+
+static void unlockRegions() {
+}
+#endif
+
+// count the allocated chunks in all segments of an arena that the user has not freed and the allocated slots in all of its slab segments
+static size_t arenaLiveChunks(arena *a) {
+	size_t count = 0;
+	lockArena(a);
+	// the slots and chunks in the remote queue are still allocated, but the user has freed them
+	drainRemote(a);
+#ifdef MYMALLOC_GROWABLE
+	for (reserved *res = a->segments; res != NULL; res = res->nextSegment) {
+		count += res->liveChunks;
+	}
+#else
+	count += ((reserved *) mem[a - arenas])->liveChunks;
+#endif
+	for (slabSegment *seg = a->slabSegments; seg != NULL; seg = seg->nextSegment) {
+		count += seg->liveSlots;
+	}
+#ifdef MYMALLOC_DEFERRED
+	// a deferred chunk is still allocated in its segment, but the user has freed it
+	count -= a->deferredChunks;
+#endif
+	unlockArena(a);
+	return count;
+}
+
+// define ptrEntry struct for a live pointer that the trace build or the profiling build keeps beside the heap
+// the trace build stores the id of the allocation, and the profiling build stores its site, its size and when it was allocated
+typedef struct ptrEntry {
+	void *ptr;
+	uint32_t id;
+	uint32_t site;
+	size_t size;
+	uint64_t time;
+} ptrEntry;
+
+#if defined(MYMALLOC_TRACE) || defined(MYMALLOC_PROFILE)
+// define ptrTable struct for a hash table with linear probing from live pointers to their entries, where an empty slot has a NULL pointer
+// the slots are mapped with mmap, since the heap can't allocate its own bookkeeping
+typedef struct ptrTable {
+	ptrEntry *slots;
+	size_t capacity;
+	size_t count;
+} ptrTable;
+// enumeration for the initial number of slots in a pointer table
+enum { PTRSLOTS = 1 << 16 };
+
+// read the monotonic clock in nanoseconds
+static uint64_t monotonicClock() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+// mix the bits of a pointer, so that the low bits of the hash depend on all of its bits
+static uint64_t hashPointer(void *ptr) {
+	uint64_t hash = ((uintptr_t) ptr >> 3) * 0x9e3779b97f4a7c15ULL;
+	return hash ^ (hash >> 32);
+}
+
+// map the slots of a pointer table, or return false if mmap fails
+static bool createTable(ptrTable *t) {
+	t->slots = mmap(NULL, PTRSLOTS * sizeof(ptrEntry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t->slots == MAP_FAILED) {
+		t->slots = NULL;
+		return false;
+	}
+	t->capacity = PTRSLOTS;
+	t->count = 0;
+	return true;
+}
+
+// find the slot of a pointer in a pointer table, or the empty slot where it would go
+static size_t findEntry(ptrTable *t, void *ptr) {
+	size_t index = hashPointer(ptr) & (t->capacity - 1);
+	while (t->slots[index].ptr != NULL && t->slots[index].ptr != ptr) {
+		index = (index + 1) & (t->capacity - 1);
+	}
+	return index;
+}
+
+// add an entry to a pointer table, doubling the table when it is half full, or return false if it can't grow
+static bool insertEntry(ptrTable *t, ptrEntry entry) {
+	if ((t->count + 1) * 2 > t->capacity) {
+		ptrEntry *old = t->slots;
+		size_t oldCapacity = t->capacity;
+		ptrEntry *grown = mmap(NULL, oldCapacity * 2 * sizeof(ptrEntry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (grown == MAP_FAILED) {
+			return false;
+		}
+		t->slots = grown;
+		t->capacity = oldCapacity * 2;
+		for (size_t i = 0; i < oldCapacity; i++) {
+			if (old[i].ptr != NULL) {
+				t->slots[findEntry(t, old[i].ptr)] = old[i];
+			}
+		}
+		munmap(old, oldCapacity * sizeof(ptrEntry));
+	}
+	t->slots[findEntry(t, entry.ptr)] = entry;
+	t->count++;
+	return true;
+}
+
+// remove the entry in a slot from a pointer table, moving back every entry after it that would no longer be found
+static void removeEntry(ptrTable *t, size_t index) {
+	size_t mask = t->capacity - 1;
+	size_t hole = index;
+	for (size_t next = (hole + 1) & mask; t->slots[next].ptr != NULL; next = (next + 1) & mask) {
+		size_t home = hashPointer(t->slots[next].ptr) & mask;
+		// move the entry into the hole if its home slot is not between the hole and where it is now
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			t->slots[hole] = t->slots[next];
+			hole = next;
+		}
+	}
+	t->slots[hole].ptr = NULL;
+	t->count--;
+}
+#endif
+
+#ifdef MYMALLOC_TRACE
+// the trace build (-DMYMALLOC_TRACE) records every call that allocates, resizes or frees memory to the file named by the MYMALLOC_TRACE
+// environment variable (mymalloc.trace by default), in the format of mytrace.h, so that it can be replayed with ./replay
+// enumeration for the number of events buffered before they are written
+enum { TRACEBUFFER = 4096 };
+
+// the trace file is opened by the first call that is recorded, and once recording fails nothing more is recorded
+// traceTable maps every live pointer to its id, and the stack of freed ids is mapped with mmap like the table
+static int traceFile = -1;
+static bool traceFailed;
+static uint64_t traceStart;
+static traceEvent traceBuffer[TRACEBUFFER];
+static size_t traceBuffered;
+static ptrTable traceTable;
+static uint32_t *freeIds;
+static size_t freeIdCapacity;
+static size_t freeIdCount;
+static uint32_t nextId;
+#ifdef MYMALLOC_THREADS
+// every call is recorded under one lock, so the order of the events is an order in which the calls could have taken effect
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint16_t traceThread;
+static uint16_t traceThreads;
+#endif
+
+// lock and unlock the trace
+static void lockTrace() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_lock(&traceLock);
+#endif
+}
+
+static void unlockTrace() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_unlock(&traceLock);
+#endif
+}
+
+// stop recording after an error, keeping what has been written so far
+static void failTrace(char *reason) {
+	printf("Error: %s, so the rest of the calls are not recorded\n", reason);
+	traceFailed = true;
+}
+
+// write the buffered events to the trace file
+static void flushTrace() {
+	char *data = (char *) traceBuffer;
+	size_t left = traceBuffered * sizeof(traceEvent);
+	while (left > 0 && !traceFailed) {
+		ssize_t written = write(traceFile, data, left);
+		if (written < 0) {
+			if (errno != EINTR) {
+				failTrace("could not write the trace file");
+			}
+			continue;
+		}
+		data += written;
+		left -= written;
+	}
+	traceBuffered = 0;
+}
+
+// write the last buffered events when the program exits
+static void closeTrace() {
+	lockTrace();
+	if (traceFile >= 0) {
+		flushTrace();
+		close(traceFile);
+		traceFile = -1;
+		traceFailed = true;
+	}
+	unlockTrace();
+}
+
+// open the trace file and write its header the first time a call is recorded, and return whether calls are being recorded
+static bool startTrace() {
+	if (traceFailed) {
+		return false;
+	}
+	if (traceFile >= 0) {
+		return true;
+	}
+	char *path = getenv("MYMALLOC_TRACE");
+	if (path == NULL || path[0] == '\0') {
+		path = "mymalloc.trace";
+	}
+	traceFile = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (traceFile < 0) {
+		failTrace("could not open the trace file");
+		return false;
+	}
+	freeIds = mmap(NULL, PTRSLOTS * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (!createTable(&traceTable) || freeIds == MAP_FAILED) {
+		failTrace("could not map the table of live pointers");
+		return false;
+	}
+	freeIdCapacity = PTRSLOTS;
+	traceHeader header = { .magic = "MYTRACE1", .version = TRACEVERSION, .eventSize = sizeof(traceEvent) };
+	char *data = (char *) &header;
+	size_t left = sizeof(header);
+	while (left > 0) {
+		ssize_t written = write(traceFile, data, left);
+		if (written < 0 && errno != EINTR) {
+			failTrace("could not write the trace file");
+			return false;
+		}
+		if (written > 0) {
+			data += written;
+			left -= written;
+		}
+	}
+	traceStart = monotonicClock();
+	atexit(closeTrace);
+	return true;
+}
+
+// add a live pointer and its id to the table of live pointers
+static void traceInsert(void *ptr, uint32_t id) {
+	ptrEntry entry = { .ptr = ptr, .id = id };
+	if (!insertEntry(&traceTable, entry)) {
+		failTrace("could not grow the table of live pointers");
+	}
+}
+
+// give an allocation the id that was freed last, or a new one
+static uint32_t takeId() {
+	if (freeIdCount > 0) {
+		return freeIds[--freeIdCount];
+	}
+	return nextId++;
+}
+
+// put the id of a freed allocation on the stack of freed ids, growing the stack when it is full
+static void releaseId(uint32_t id) {
+	if (freeIdCount == freeIdCapacity) {
+		uint32_t *grown = mremap(freeIds, freeIdCapacity * sizeof(uint32_t), freeIdCapacity * 2 * sizeof(uint32_t), MREMAP_MAYMOVE);
+		if (grown == MAP_FAILED) {
+			failTrace("could not grow the stack of freed ids");
+			return;
+		}
+		freeIds = grown;
+		freeIdCapacity *= 2;
+	}
+	freeIds[freeIdCount++] = id;
+}
+
+// buffer an event, writing the buffer to the trace file when it is full
+static void writeEvent(int op, size_t size, uint32_t id, size_t alignment) {
+	traceEvent *e = &traceBuffer[traceBuffered++];
+	e->time = monotonicClock() - traceStart;
+	e->size = size;
+	e->id = id;
+	e->op = op;
+	e->alignShift = __builtin_ctzl(alignment);
+#ifdef MYMALLOC_THREADS
+	if (traceThread == 0) {
+		traceThread = ++traceThreads;
+	}
+	e->thread = traceThread;
+#else
+	e->thread = 0;
+#endif
+	if (traceBuffered == TRACEBUFFER) {
+		flushTrace();
+	}
+}
+
+// record a call that allocated size bytes aligned to alignment at ptr, unless it failed
+static void traceAlloc(int op, void *ptr, size_t size, size_t alignment) {
+	if (ptr == NULL) {
+		return;
+	}
+	lockTrace();
+	if (startTrace()) {
+		uint32_t id = takeId();
+		traceInsert(ptr, id);
+		writeEvent(op, size, id, alignment);
+	}
+	unlockTrace();
+}
+
+// record a call that frees ptr, before it is freed so that no other thread can allocate the same pointer first
+// a pointer that is not live is not recorded, since the call only reports an error
+static void traceFree(void *ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+	lockTrace();
+	if (startTrace()) {
+		size_t index = findEntry(&traceTable, ptr);
+		if (traceTable.slots[index].ptr != NULL) {
+			uint32_t id = traceTable.slots[index].id;
+			removeEntry(&traceTable, index);
+			releaseId(id);
+			writeEvent(TRACEFREE, 0, id, 1);
+		}
+	}
+	unlockTrace();
+}
+
+// take a live pointer that is about to be resized out of the table and return its id, or return -1 if it is not live
+// the old pointer may be freed by the resize, so it must not be in the table when another thread allocates it again
+static int64_t traceTake(void *ptr) {
+	int64_t id = -1;
+	lockTrace();
+	if (startTrace()) {
+		size_t index = findEntry(&traceTable, ptr);
+		if (traceTable.slots[index].ptr != NULL) {
+			id = traceTable.slots[index].id;
+			removeEntry(&traceTable, index);
+		}
+	}
+	unlockTrace();
+	return id;
+}
+
+// record a call that resized the allocation with an id to size bytes at newPtr, or put the old pointer back if the resize failed
+static void traceMove(void *ptr, int64_t id, void *newPtr, size_t size) {
+	if (id < 0) {
+		return;
+	}
+	lockTrace();
+	if (newPtr == NULL) {
+		traceInsert(ptr, id);
+	} else {
+		traceInsert(newPtr, id);
+		writeEvent(TRACEREALLOC, size, id, MYMALLOC_ALIGNMENT);
+	}
+	unlockTrace();
+}
+#else
+// nothing is recorded unless the trace build is used
+static void traceAlloc(int op, void *ptr, size_t size, size_t alignment) {
+}
+
+static void traceFree(void *ptr) {
+}
+
+static int64_t traceTake(void *ptr) {
+	return -1;
+}
+
+static void traceMove(void *ptr, int64_t id, void *newPtr, size_t size) {
+}
+#endif
+
+#ifdef MYMALLOC_PROFILE
+// the profiling build (-DMYMALLOC_PROFILE) samples 1 in MYMALLOC_PROFILE_RATE allocations and keeps counters for the site (file and line)
+// that allocated them, and prints the leaking and hottest sites when the program exits
+// the chunk struct has no room for a site, so a sampled pointer is kept beside the heap in profileTable with the id of its site,
+// its size and when it was allocated
+// enumeration for the number of sites with counters of their own (the rest share the last one), the number of counters of the filter,
+// and the number of sites printed in each list
+enum {
+	MAXSITES = 4096,
+	PROFILEFILTER = 1 << 16,
+	TOPSITES = 10
+};
+
+// define site struct containing the counters of the sampled allocations of one site
+// lifetime adds up the nanoseconds between the allocation and the free of every sampled allocation that has been freed
+typedef struct site {
+	char *file;
+	int line;
+	size_t allocations;
+	size_t bytes;
+	size_t live;
+	size_t liveBytes;
+	size_t freed;
+	uint64_t lifetime;
+} site;
+
+// siteIndex is a hash table from a file and line to the index of its site in sites, where 0 is an empty slot
+// profileFilter counts the sampled pointers that hash to each of its counters, so myfree only takes the lock when the counter of its pointer
+// is not 0, and most pointers that were never sampled are let through without it
+static site sites[MAXSITES];
+static size_t siteCount;
+static uint16_t siteIndex[MAXSITES * 2];
+static uint32_t profileFilter[PROFILEFILTER];
+static ptrTable profileTable;
+static bool profileStarted;
+#ifdef MYMALLOC_THREADS
+static pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread size_t profileCountdown;
+static __thread uint64_t profileRandom;
+#else
+static size_t profileCountdown;
+static uint64_t profileRandom;
+#endif
+
+// lock and unlock the profile
+static void lockProfile() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_lock(&profileLock);
+#endif
+}
+
+static void unlockProfile() {
+#ifdef MYMALLOC_THREADS
+	pthread_mutex_unlock(&profileLock);
+#endif
+}
+
+// get the counter of the filter for a pointer
+static uint32_t *filterCounter(void *ptr) {
+	return &profileFilter[hashPointer(ptr) >> 48];
+}
+
+// find the index of the site of a file and line, adding the site if it is new
+// a file name is compared by pointer first, since every call in a file passes the same __FILE__ string
+static uint32_t findSite(char *file, int line) {
+	uint64_t hash = (hashPointer(file) ^ ((uint64_t) line * 0x9e3779b97f4a7c15ULL)) & (MAXSITES * 2 - 1);
+	while (siteIndex[hash] != 0) {
+		site *s = &sites[siteIndex[hash] - 1];
+		if (s->line == line && (s->file == file || strcmp(s->file, file) == 0)) {
+			return siteIndex[hash] - 1;
+		}
+		hash = (hash + 1) & (MAXSITES * 2 - 1);
+	}
+	if (siteCount == MAXSITES - 1) {
+		sites[MAXSITES - 1].file = "(other sites)";
+		return MAXSITES - 1;
+	}
+	sites[siteCount].file = file;
+	sites[siteCount].line = line;
+	siteIndex[hash] = ++siteCount;
+	return siteCount - 1;
+}
+
+// add a sampled pointer to the table and its site, or stop sampling if the table can't grow
+static void addSample(ptrEntry entry) {
+	if (!insertEntry(&profileTable, entry)) {
+		printf("Error: could not grow the table of sampled pointers, so the rest of the allocations are not sampled\n");
+		profileStarted = false;
+		return;
+	}
+	__atomic_fetch_add(filterCounter(entry.ptr), 1, __ATOMIC_RELAXED);
+	site *s = &sites[entry.site];
+	s->live++;
+	s->liveBytes += entry.size;
+}
+
+// take a sampled pointer out of the table and its site, and return its entry, or an entry with a NULL pointer if it was not sampled
+static ptrEntry takeSample(void *ptr) {
+	ptrEntry entry = { .ptr = NULL };
+	if (LOAD(filterCounter(ptr)) == 0) {
+		return entry;
+	}
+	lockProfile();
+	if (profileTable.slots != NULL) {
+		size_t index = findEntry(&profileTable, ptr);
+		if (profileTable.slots[index].ptr != NULL) {
+			entry = profileTable.slots[index];
+			removeEntry(&profileTable, index);
+			__atomic_fetch_sub(filterCounter(ptr), 1, __ATOMIC_RELAXED);
+			site *s = &sites[entry.site];
+			s->live--;
+			s->liveBytes -= entry.size;
+		}
+	}
+	unlockProfile();
+	return entry;
+}
+
+// compare two sites by live bytes or by allocations for qsort, from the most to the fewest
+static int compareLiveBytes(const void *a, const void *b) {
+	size_t x = sites[*(const uint16_t *) a].liveBytes;
+	size_t y = sites[*(const uint16_t *) b].liveBytes;
+	return (x < y) - (x > y);
+}
+
+static int compareAllocations(const void *a, const void *b) {
+	size_t x = sites[*(const uint16_t *) a].allocations;
+	size_t y = sites[*(const uint16_t *) b].allocations;
+	return (x < y) - (x > y);
+}
+
+// print the leaking sites by live bytes and the hottest sites by allocations when the program exits
+// the counters are multiplied by the sample rate, so they estimate what every allocation did
+static void dumpProfile() {
+	static uint16_t order[MAXSITES];
+	lockProfile();
+	size_t count = siteCount;
+	if (sites[MAXSITES - 1].allocations > 0) {
+		order[count++] = MAXSITES - 1;
+	}
+	for (size_t i = 0; i < siteCount; i++) {
+		order[i] = i;
+	}
+	printf("Allocation profile (1 in %d allocations sampled):\n", MYMALLOC_PROFILE_RATE);
+	printf("Leaking sites:\n");
+	qsort(order, count, sizeof(uint16_t), compareLiveBytes);
+	for (size_t i = 0; i < count && i < TOPSITES && sites[order[i]].live > 0; i++) {
+		site *s = &sites[order[i]];
+		printf("\tfile %s at line %d: %zu live allocations of %zu bytes\n", s->file, s->line,
+			s->live * MYMALLOC_PROFILE_RATE, s->liveBytes * MYMALLOC_PROFILE_RATE);
+	}
+	printf("Hottest sites:\n");
+	qsort(order, count, sizeof(uint16_t), compareAllocations);
+	for (size_t i = 0; i < count && i < TOPSITES; i++) {
+		site *s = &sites[order[i]];
+		printf("\tfile %s at line %d: %zu allocations of %zu bytes, %zu live, average lifetime %.1f microseconds\n", s->file, s->line,
+			s->allocations * MYMALLOC_PROFILE_RATE, s->bytes * MYMALLOC_PROFILE_RATE, s->live * MYMALLOC_PROFILE_RATE,
+			s->freed > 0 ? s->lifetime / 1e3 / s->freed : 0.0);
+	}
+	unlockProfile();
+}
+
+// map the table of sampled pointers and register the dump the first time an allocation is sampled, and return whether allocations are sampled
+static bool startProfile() {
+	static bool failed;
+	if (profileStarted || failed) {
+		return profileStarted;
+	}
+	if (!createTable(&profileTable)) {
+		printf("Error: could not map the table of sampled pointers, so allocations are not sampled\n");
+		failed = true;
+		return false;
+	}
+	profileStarted = true;
+	atexit(dumpProfile);
+	return true;
+}
+
+// draw the number of allocations until the next sample uniformly from 1 to 2 * MYMALLOC_PROFILE_RATE - 1, so the mean is the rate
+// but a loop that allocates in a fixed pattern is not always sampled at the same place
+// the xorshift generator of every thread is seeded with the address of its state
+static size_t nextCountdown() {
+	if (profileRandom == 0) {
+		profileRandom = (uintptr_t) &profileRandom | 1;
+	}
+	profileRandom ^= profileRandom << 13;
+	profileRandom ^= profileRandom >> 7;
+	profileRandom ^= profileRandom << 17;
+	return 1 + profileRandom % (2 * MYMALLOC_PROFILE_RATE - 1);
+}
+
+// count an allocation of size bytes at ptr by the site at file and line if it is sampled
+// every thread counts down to its next sample, so an allocation that is not sampled costs one decrement
+static void profileAlloc(void *ptr, size_t size, char *file, int line) {
+	if (ptr == NULL) {
+		return;
+	}
+	if (profileCountdown > 1) {
+		profileCountdown--;
+		return;
+	}
+	profileCountdown = nextCountdown();
+	lockProfile();
+	if (startProfile()) {
+		ptrEntry entry = { .ptr = ptr, .site = findSite(file, line), .size = size, .time = monotonicClock() };
+		sites[entry.site].allocations++;
+		sites[entry.site].bytes += size;
+		addSample(entry);
+	}
+	unlockProfile();
+}
+
+// count the free of ptr by the site that allocated it if it was sampled, before it is freed so that no other thread can allocate it first
+static void profileFree(void *ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+	ptrEntry entry = takeSample(ptr);
+	if (entry.ptr != NULL) {
+		lockProfile();
+		sites[entry.site].freed++;
+		sites[entry.site].lifetime += monotonicClock() - entry.time;
+		unlockProfile();
+	}
+}
+
+// take a sampled pointer that is about to be resized out of the table, like traceTake
+static ptrEntry profileTake(void *ptr) {
+	return takeSample(ptr);
+}
+
+// put a sampled pointer back with its new pointer and size after a resize, or with its old ones if the resize failed
+// it keeps the site that allocated it, which counts the bytes it grew by
+static void profileMove(ptrEntry entry, void *newPtr, size_t size) {
+	if (entry.ptr == NULL) {
+		return;
+	}
+	lockProfile();
+	if (newPtr != NULL) {
+		if (size > entry.size) {
+			sites[entry.site].bytes += size - entry.size;
+		}
+		entry.ptr = newPtr;
+		entry.size = size;
+	}
+	if (profileStarted) {
+		addSample(entry);
+	}
+	unlockProfile();
+}
+
+// print the sites that have live sampled allocations, for isMemoryLeaking
+static void printLeakingSites() {
+	lockProfile();
+	for (size_t i = 0; i < MAXSITES; i++) {
+		site *s = &sites[i];
+		if (s->live > 0) {
+			printf("Leak at file %s at line %d: %zu live allocations of %zu bytes\n", s->file, s->line,
+				s->live * MYMALLOC_PROFILE_RATE, s->liveBytes * MYMALLOC_PROFILE_RATE);
+		}
+	}
+	unlockProfile();
+}
+#else
+// nothing is sampled unless the profiling build is used
+static void profileAlloc(void *ptr, size_t size, char *file, int line) {
+}
+
+static void profileFree(void *ptr) {
+}
+
+static ptrEntry profileTake(void *ptr) {
+	ptrEntry entry = { .ptr = NULL };
+	return entry;
+}
+
+static void profileMove(ptrEntry entry, void *newPtr, size_t size) {
+}
+
+static void printLeakingSites() {
+}
+#endif
+
+#ifdef MYMALLOC_THREADS
+// fork() copies the heap in whatever state the other threads left it, but only the calling thread goes on in the child,
+// so every lock of the heap is taken before fork() and given back after it in the parent and in the child, which leaves the child a consistent heap
+// they are taken in the order in which a call can hold two of them, which is the trace or profile lock before an arena lock, so this can't deadlock
+// the caches of the other threads are copied into the child too, where their slots and chunks stay cached with no thread to use them
+static void lockHeap() {
+#ifdef MYMALLOC_PROFILE
+	lockProfile();
+#endif
+#ifdef MYMALLOC_TRACE
+	lockTrace();
+#endif
+	lockRegions();
+	pthread_mutex_lock(&cacheLock);
+	for (int i = 0; i < NARENAS; i++) {
+		lockArena(&arenas[i]);
+	}
+	lockMappedStats();
+}
+
+static void unlockHeap() {
+	unlockMappedStats();
+	for (int i = NARENAS - 1; i >= 0; i--) {
+		unlockArena(&arenas[i]);
+	}
+	pthread_mutex_unlock(&cacheLock);
+	unlockRegions();
+#ifdef MYMALLOC_TRACE
+	unlockTrace();
+#endif
+#ifdef MYMALLOC_PROFILE
+	unlockProfile();
+#endif
+}
+
+// register the fork handlers when the program or library is loaded, before it can start a thread
+// pthread_atfork may allocate, so it is not called from inside the allocator
+__attribute__((constructor)) static void registerForkHandlers() {
+	pthread_atfork(lockHeap, unlockHeap, unlockHeap);
+}
+#endif
+
+// compute the slot size or chunk data size that holds size bytes, which is the smallest multiple of the alignment at least as large as size for a slot,
+// or the data size from roundChunk for a chunk, and no smaller than the smallest data size
+static size_t roundSize(size_t size) {
+	if (size <= MYMALLOC_SLABMAX) {
+		size = (size + MYMALLOC_ALIGNMENT - 1) & ~(size_t) (MYMALLOC_ALIGNMENT - 1);
+	} else {
+		size = roundChunk(size);
+	}
+	if (size < MINDATA) {
+		size = MINDATA;
+	}
+	return size;
+}
+
+// check whether size bytes of data with room bytes for an alignment get a chunk with a mapping of their own
+// which is when size is at least the mmap threshold or greater than the maximum data size (minus the room)
+static bool isMappedSize(size_t size, size_t room) {
+	return (MYMALLOC_MMAP_THRESHOLD != 0 && size >= MYMALLOC_MMAP_THRESHOLD) || room > MAXDATA || size > MAXDATA - room;
+}
+
+// allocate size bytes of data aligned to alignment, which is a power of two, or return NULL
+static void *allocData(size_t size, size_t alignment) {
+	// if size is 0, return NULL
+	if (size == 0) {
+		return NULL;
+	}
+	// an aligned chunk needs room in its segment to move its data up to the alignment
+	size_t room = 0;
+	if (alignment > MYMALLOC_ALIGNMENT) {
+		room = alignment + sizeof(chunk) + MINDATA + MYMALLOC_ALIGNMENT - 8;
+	}
+	// if size is at least the mmap threshold, or greater than the maximum data size, which is total segment size minus reserved and chunk struct
+	// (and minus the room for the alignment), then the chunk gets a mapping of its own, so it doesn't take a segment apart and myfree can unmap it directly
+	// if the mmap threshold is 0, then return NULL for a size greater than the maximum data size
+	if (isMappedSize(size, room)) {
+		chunk *c = NULL;
+		if (MYMALLOC_MMAP_THRESHOLD != 0) {
+			c = mapChunk(size, alignment);
+		}
+		if (c == NULL) {
+			return NULL;
+		}
+		return (void *) ((char *) c + sizeof(chunk));
+	}
+	size = roundSize(size);
+	// slots are only aligned to MYMALLOC_ALIGNMENT bytes, so an aligned allocation always takes a chunk
+	if (alignment > MYMALLOC_ALIGNMENT && size <= MYMALLOC_SLABMAX) {
+		size = roundChunk(MYMALLOC_SLABMAX + 1);
+	}
+	// small sizes come from the thread cache if there is one
+	void *ptr = NULL;
+	if (size <= TCACHEMAX && alignment <= MYMALLOC_ALIGNMENT) {
+		ptr = cacheMalloc(size);
+	}
+	if (ptr != NULL) {
+		return ptr;
+	}
+	// otherwise take a slot from a slab of the thread's arena if size is at most MYMALLOC_SLABMAX,
+	// or look up a free chunk that is big enough to hold the data in the free block index of the thread's arena
+	arena *a = lockThreadArena();
+	initArena(a);
+	ptr = arenaMalloc(a, size, alignment);
+	unlockArena(a);
+	// if there is no such slot or chunk, then give the slots and chunks of the thread cache back to the heap
+	// and try every arena starting with the thread's arena before returning NULL
+	if (ptr == NULL) {
+		flushThreadCache();
+		for (int i = 0; i < NARENAS && ptr == NULL; i++) {
+			arena *other = &arenas[(a - arenas + i) % NARENAS];
+			lockArena(other);
+			drainRemote(other);
+			initArena(other);
+			ptr = arenaMalloc(other, size, alignment);
+			unlockArena(other);
+		}
+	}
+	return ptr;
+}
+void *mymalloc(size_t size, char *file, int line) {
+	void *ptr = allocData(size, MYMALLOC_ALIGNMENT);
+	traceAlloc(TRACEMALLOC, ptr, size, MYMALLOC_ALIGNMENT);
+	profileAlloc(ptr, size, file, line);
+	return ptr;
+}
+#ifdef MYMALLOC_HARDENED
+// check the canaries of the chunk structs before and after the chunk of a pointer in use, and printf error message with file and line number
+// and return true if one was overwritten, which reads only the two chunk structs, so it costs O(1) like the rest of the checks
+// the chunk struct before is found from the boundary tag, which must point between the first chunk and the chunk itself
+static bool isCorrupted(reserved *res, chunk *c, void *ptr, char *file, int line) {
+	if (c != firstChunk(res)) {
+		size_t prevSize = LOAD(&c->prevSize);
+		if ((prevSize & 7) != 0 || prevSize > (size_t) ((char *) c - (char *) firstChunk(res)) - sizeof(chunk) ||
+			!isIntact((chunk *) ((char *) c - prevSize - sizeof(chunk)))) {
+			printf("Error at file %s at line %d: pointer %p has a corrupted chunk header\n", file, line, ptr);
+			return true;
+		}
+	}
+	chunk *next = nextChunk(c);
+	if ((char *) next < (char *) res + SEGMENTSIZE && !isIntact(next)) {
+		printf("Error at file %s at line %d: pointer %p has overflowed into the next chunk\n", file, line, ptr);
+		return true;
+	}
+	return false;
+}
+#endif
+#if MYMALLOC_DIAGNOSTICS
+// find the slab of a pointer into a slab segment that is a slot in use, or printf error message with file and line number and return NULL
+static slab *findSlot(void *ptr, char *file, int line) {
+	// if the pointer is in the first page of the slab segment, which holds the slabSegment struct, or in a page that has never been a slab, or
+	// if the pointer is in the slab struct or after the last slot of the slab, then
+	// printf error message with file and line number saying that the pointer is not obtained from malloc and return
+	slab *s = slabOf(ptr);
+	size_t size = 0;
+	if ((char *) s != (char *) slabSegmentOf(ptr)) {
+		size = LOAD(&s->slotSize);
+	}
+	size_t offset = (char *) ptr - (char *) s - SLABHEADER;
+	if (size == 0 || (char *) ptr < (char *) s + SLABHEADER || offset / size >= slabSlots(size)) {
+		printf("Error at file %s at line %d: pointer %p is not obtained from malloc\n", file, line, ptr);
+		return NULL;
+	}
+	// if the bit of the slot that contains the pointer is clear or the slot is cached, then printf error message saying that it has already been freed
+	// otherwise, if the pointer is not at the start of the slot, then printf error message saying that it is not at the start of the chunk
+	size_t index = offset / size;
+	uint64_t bit = (uint64_t) 1 << (index & 63);
+	if ((LOAD(&s->used[index >> 6]) & bit) == 0 || (LOAD(&s->cached[index >> 6]) & bit) != 0) {
+		printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+		return NULL;
+	}
+	if (offset % size != 0) {
+		printf("Error at file %s at line %d: pointer %p is not at the start of the chunk\n", file, line, ptr);
+		return NULL;
+	}
+	return s;
+}
+// find the chunk struct of a pointer that is in use, or printf error message with file and line number and return NULL
+static chunk *findChunk(void *ptr, char *file, int line) {
+	// find the segment that contains the pointer from its address
+	// if no segment contains the pointer, then it may be the data of a chunk with a mapping of its own, which starts at the beginning of its mapping,
+	// so if the pointer is not right after the chunk struct of that mapping, then print error message saying that it is not at the start of the chunk,
+	// and if the mapping has been unmapped, then print error message saying that the pointer has already been freed
+	reserved *res = findSegment(ptr);
+	if (res == NULL) {
+		uint8_t kind = segmentKind(ptr);
+		mapping *m = (mapping *) mapBase(ptr);
+		if (kind == BIGSEGMENT && (char *) ptr == (char *) m + LOAD(&m->dataOffset)) {
+#ifdef MYMALLOC_HARDENED
+			if (!isIntact((chunk *) ((char *) ptr - sizeof(chunk)))) {
+				printf("Error at file %s at line %d: pointer %p has a corrupted chunk header\n", file, line, ptr);
+				return NULL;
+			}
+#endif
+			return (chunk *) ((char *) ptr - sizeof(chunk));
+		}
+		if (kind == BIGSEGMENT) {
+			printf("Error at file %s at line %d: pointer %p is not at the start of the chunk\n", file, line, ptr);
+		} else if (kind == FREEDSEGMENT) {
+			printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+		} else {
+			printf("Error at file %s at line %d: pointer %p is not obtained from malloc\n", file, line, ptr);
+		}
+		return NULL;
+	}
+	// if the first chunk of the segment has a data size of 0 meaning it has never been allocated, or
+	// if the ptr is not in the range between the end of the reserved + chunk struct and the last index of the segment, then
+	// printf error message with file and line number saying that the pointer is not obtained from malloc and return
+	if (LOAD(&firstChunk(res)->dataSize) == 0 || (char *) ptr < (char *) firstChunk(res) + sizeof(chunk)) {
+		printf("Error at file %s at line %d: pointer %p is not obtained from malloc\n", file, line, ptr);
+		return NULL;
+	}
+	// the chunk struct sits right before the pointer
+	// if the chunk start bitmap has no chunk there, then the pointer is somewhere inside a chunk, so find that chunk
+	// if the pointer is in the data of a chunk in use, then print error message saying that it is not at the start of the chunk
+	// if the pointer is in a free or cached chunk, then print error message saying that it has already been freed
+	// example diagram where each hexadecimal represents 1 byte:
+	// chunk[0x5] data[0x6 0x7] chunk[0x8] free[0x9 0xa]
+	// if ptr is 0x7, then it is not at the start of the chunk, and if ptr is 0xa, then it has already been freed
+	chunk *c = (chunk *) ((char *) ptr - sizeof(chunk));
+	size_t word = ((char *) c - (char *) res) >> 3;
+	if (((size_t) ptr & 7) != 0 || (LOAD(&segmentStarts(res)[word >> 6]) & ((uint64_t) 1 << (word & 63))) == 0) {
+		arena *a = segmentArena(res);
+		lockArena(a);
+		bool inUse = isInUse(containingChunk(res, (char *) ptr));
+		unlockArena(a);
+		if (inUse) {
+			printf("Error at file %s at line %d: pointer %p is not at the start of the chunk\n", file, line, ptr);
+		} else {
+			printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+		}
+		return NULL;
+	}
+#ifdef MYMALLOC_HARDENED
+	// in the hardened build, if the chunk struct lost its canary, then its status bits can't be trusted either,
+	// so printf error message saying that the chunk header is corrupted before looking at them
+	if (!isIntact(c)) {
+		printf("Error at file %s at line %d: pointer %p has a corrupted chunk header\n", file, line, ptr);
+		return NULL;
+	}
+#endif
+	// if the chunk is already free or cached, then printf error message saying that the pointer has already been freed
+	if (!isInUse(c)) {
+		printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+		return NULL;
+	}
+#ifdef MYMALLOC_HARDENED
+	// the chunk is left allocated if a chunk struct next to it was overwritten, since coalescing with it would spread the damage
+	if (isCorrupted(res, c, ptr, file, line)) {
+		return NULL;
+	}
+#endif
+	return c;
+}
+#else
+// without diagnostics, a pointer into a slab segment is trusted to be a slot in use, so its slab is found by masking it
+static slab *findSlot(void *ptr, char *file, int line) {
+	return slabOf(ptr);
+}
+// without diagnostics, a pointer is trusted to be the data of a chunk in use, whose chunk struct sits right before it,
+// and only a NULL pointer is skipped, so that freeing it does nothing like in the C library
+static chunk *findChunk(void *ptr, char *file, int line) {
+	if (ptr == NULL) {
+		return NULL;
+	}
+	return (chunk *) ((char *) ptr - sizeof(chunk));
+}
+#endif
+// free the slot or chunk of the pointer, or printf error message with file and line number if it can't be freed
+static void freeData(void *ptr, char *file, int line) {
+	// find the slot or chunk of the pointer, which prints an error message if the pointer can't be freed
+	size_t size;
+	if (segmentKind(ptr) == SLABSEGMENT) {
+		slab *s = findSlot(ptr, file, line);
+		if (s == NULL) {
+			return;
+		}
+		size = s->slotSize;
+	} else {
+		chunk *c = findChunk(ptr, file, line);
+		if (c == NULL) {
+			return;
+		}
+		// a chunk with a mapping of its own is unmapped directly
+		if (isMapped(c)) {
+			unmapChunk(c);
+			return;
+		}
+		size = chunkSize(c);
+	}
+#ifdef MYMALLOC_NUMA
+	// a slot or chunk of another node goes back to its node with the next batch
+	if (remoteFree(ptr, size)) {
+		return;
+	}
+#endif
+	// small slots and chunks go to the thread cache if there is one,
+	// otherwise free the slot into its slab, or free the chunk and coalesce it with its neighbors, in its own arena
+	if (size <= TCACHEMAX) {
+		cacheFree(ptr, size);
+		return;
+	}
+	// a slot or chunk of another thread's arena goes to the remote queue of that arena instead of taking its lock
+	arena *a = ownerArena(ptr, size);
+	if (queueRemote(a, ptr, size)) {
+		return;
+	}
+	lockArena(a);
+	drainRemote(a);
+	arenaFree(a, ptr, size);
+	unlockArena(a);
+}
+// free the chunk that contains the pointer
+void myfree(void *ptr, char *file, int line) {
+	traceFree(ptr);
+	profileFree(ptr);
+	freeData(ptr, file, line);
+}
+// resize the slot or chunk of a pointer that is not NULL to a size that is not 0, or printf error message with file and line number and return NULL
+static void *reallocData(void *ptr, size_t size, char *file, int line) {
+	// find the slot or chunk of the pointer, which prints an error message if the pointer can't be reallocated
+	size_t oldSize;
+	if (segmentKind(ptr) == SLABSEGMENT) {
+		slab *s = findSlot(ptr, file, line);
+		if (s == NULL) {
+			return NULL;
+		}
+		oldSize = s->slotSize;
+	} else {
+		chunk *c = findChunk(ptr, file, line);
+		if (c == NULL) {
+			return NULL;
+		}
+		// a chunk with a mapping of its own is resized with mremap, and if that fails, the old chunk is left as it was
+		if (isMapped(c)) {
+			chunk *moved = remapChunk(c, size);
+			if (moved == NULL) {
+				return NULL;
+			}
+			return (void *) ((char *) moved + sizeof(chunk));
+		}
+		oldSize = chunkSize(c);
+		// if the new size still belongs in a chunk, which is more than MYMALLOC_SLABMAX and less than the mmap threshold,
+		// then shrink the chunk in place by splitting off the rest, or grow it in place by taking in the next chunk if that is free and big enough
+		if (size > MYMALLOC_SLABMAX && !isMappedSize(size, 0)) {
+			size_t newSize = roundSize(size);
+			arena *a = segmentArena(segmentOf(c));
+			bool resized = true;
+			lockArena(a);
+			if (newSize <= oldSize) {
+				shrinkChunk(a, c, newSize);
+			} else {
+				resized = growChunk(a, c, newSize);
+			}
+			unlockArena(a);
+			if (resized) {
+				return ptr;
+			}
+		}
+	}
+	// if the slot or chunk already has enough data, then keep it
+	if (size <= oldSize) {
+		return ptr;
+	}
+	// otherwise allocate a new slot or chunk, copy the data over and free the old one, and if that fails, the old one is left as it was
+	void *newPtr = allocData(size, MYMALLOC_ALIGNMENT);
+	if (newPtr == NULL) {
+		return NULL;
+	}
+	memcpy(newPtr, ptr, oldSize);
+	freeData(ptr, file, line);
+	return newPtr;
+}
+// change the size of the chunk that contains the pointer, keeping its data up to the smaller of the old and new size
+void *myrealloc(void *ptr, size_t size, char *file, int line) {
+	// a NULL pointer is allocated like malloc, and a size of 0 frees the pointer like free and returns NULL
+	if (ptr == NULL) {
+		return mymalloc(size, file, line);
+	}
+	if (size == 0) {
+		myfree(ptr, file, line);
+		return NULL;
+	}
+	int64_t id = traceTake(ptr);
+	ptrEntry sample = profileTake(ptr);
+	void *newPtr = reallocData(ptr, size, file, line);
+	traceMove(ptr, id, newPtr, size);
+	profileMove(sample, newPtr, size);
+	return newPtr;
+}
+// allocate an array of count elements of size bytes each with every byte set to 0
+void *mycalloc(size_t count, size_t size, char *file, int line) {
+	// if count * size overflows, then return NULL
+	if (size != 0 && count > SIZE_MAX / size) {
+		return NULL;
+	}
+	void *ptr = allocData(count * size, MYMALLOC_ALIGNMENT);
+	if (ptr == NULL) {
+		return NULL;
+	}
+	// a chunk with a mapping of its own is fresh from mmap, which already set every byte to 0, so only other memory is cleared
+	if (segmentKind(ptr) != BIGSEGMENT) {
+		memset(ptr, 0, count * size);
+	}
+	traceAlloc(TRACECALLOC, ptr, count * size, MYMALLOC_ALIGNMENT);
+	profileAlloc(ptr, count * size, file, line);
+	return ptr;
+}
+// allocate size bytes of data aligned to alignment, which must be a power of two
+void *myaligned_alloc(size_t alignment, size_t size, char *file, int line) {
+	// if alignment is not a power of two, then return NULL
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		return NULL;
+	}
+	// every allocation is aligned to MYMALLOC_ALIGNMENT bytes, so a smaller alignment is a plain allocation
+	if (alignment < MYMALLOC_ALIGNMENT) {
+		alignment = MYMALLOC_ALIGNMENT;
+	}
+	void *ptr = allocData(size, alignment);
+	traceAlloc(TRACEALIGNED, ptr, size, alignment);
+	profileAlloc(ptr, size, file, line);
+	return ptr;
+}
+// allocate size bytes of data aligned to alignment and store the pointer in memptr, returning 0 on success or an error number
+int myposix_memalign(void **memptr, size_t alignment, size_t size, char *file, int line) {
+	// if alignment is not a power of two multiple of the size of a pointer, then return EINVAL
+	if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+	// a size of 0 stores a NULL pointer, and otherwise return ENOMEM if the allocation fails
+	void *ptr = NULL;
+	if (size != 0) {
+		ptr = myaligned_alloc(alignment, size, file, line);
+		if (ptr == NULL) {
+			return ENOMEM;
+		}
+	}
+	*memptr = ptr;
+	return 0;
+}
+// get the number of bytes of the slot or chunk of a pointer that can be used, which can be more than were asked for,
+// or printf error message with file and line number and return 0 if the pointer is not in use, and return 0 for a NULL pointer
+size_t mymalloc_usable_size(void *ptr, char *file, int line) {
+	if (ptr == NULL) {
+		return 0;
+	}
+	if (segmentKind(ptr) == SLABSEGMENT) {
+		slab *s = findSlot(ptr, file, line);
+		return s == NULL ? 0 : LOAD(&s->slotSize);
+	}
+	chunk *c = findChunk(ptr, file, line);
+	return c == NULL ? 0 : chunkSize(c);
+}
+// compare two pointers by address for qsort
+static int comparePointers(const void *a, const void *b) {
+	uintptr_t x = (uintptr_t) *(void * const *) a;
+	uintptr_t y = (uintptr_t) *(void * const *) b;
+	return (x > y) - (x < y);
+}
+// allocate count blocks of size bytes each into ptrs and return how many were allocated, setting the rest of ptrs to NULL
+size_t mymalloc_batch(size_t size, size_t count, void **ptrs, char *file, int line) {
+	// take as many slots or chunks as the thread's arena can give under one lock acquisition
+	// blocks that get a mapping of their own share no metadata, so they are mapped one by one below
+	size_t allocated = 0;
+	if (size != 0 && !isMappedSize(size, 0)) {
+		size_t rounded = roundSize(size);
+		arena *a = lockThreadArena();
+		initArena(a);
+		while (allocated < count) {
+			void *ptr = arenaMalloc(a, rounded, MYMALLOC_ALIGNMENT);
+			if (ptr == NULL) {
+				break;
+			}
+			ptrs[allocated++] = ptr;
+		}
+		unlockArena(a);
+	}
+	// allocate the rest one by one, which gives back the thread cache and tries every arena before giving up
+	while (allocated < count) {
+		void *ptr = allocData(size, MYMALLOC_ALIGNMENT);
+		if (ptr == NULL) {
+			break;
+		}
+		ptrs[allocated++] = ptr;
+	}
+	for (size_t i = 0; i < allocated; i++) {
+		traceAlloc(TRACEMALLOC, ptrs[i], size, MYMALLOC_ALIGNMENT);
+		profileAlloc(ptrs[i], size, file, line);
+	}
+	for (size_t i = allocated; i < count; i++) {
+		ptrs[i] = NULL;
+	}
+	return allocated;
+}
+// free count pointers in ptrs, skipping NULL pointers
+// ptrs is sorted by address in place, and the pointers that can't be freed are set to NULL
+void myfree_batch(void **ptrs, size_t count, char *file, int line) {
+	// sort the pointers by address, so that the chunks of a segment are freed in one sweep where each one coalesces with the one before it,
+	// and the pointers of an arena come one after another
+	qsort(ptrs, count, sizeof(void *), comparePointers);
+	// check every pointer before any lock is held, because reporting an error may need the lock of an arena
+	// a pointer that appears more than once has already been freed by the time its next copy comes up
+	void *prev = NULL;
+	for (size_t i = 0; i < count; i++) {
+		void *ptr = ptrs[i];
+		if (ptr == NULL) {
+			continue;
+		}
+		bool valid;
+		if (ptr == prev) {
+			printf("Error at file %s at line %d: pointer %p has already been freed\n", file, line, ptr);
+			valid = false;
+		} else if (segmentKind(ptr) == SLABSEGMENT) {
+			valid = findSlot(ptr, file, line) != NULL;
+		} else {
+			valid = findChunk(ptr, file, line) != NULL;
+		}
+		prev = ptr;
+		if (!valid) {
+			ptrs[i] = NULL;
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		traceFree(ptrs[i]);
+		profileFree(ptrs[i]);
+	}
+	// free the slots and chunks into their arenas, switching the lock only when the arena changes
+	// a chunk with a mapping of its own is unmapped directly
+	arena *locked = NULL;
+	for (size_t i = 0; i < count; i++) {
+		void *ptr = ptrs[i];
+		if (ptr == NULL) {
+			continue;
+		}
+		size_t size;
+		if (segmentKind(ptr) == SLABSEGMENT) {
+			size = slabOf(ptr)->slotSize;
+		} else {
+			chunk *c = (chunk *) ((char *) ptr - sizeof(chunk));
+			if (isMapped(c)) {
+				unmapChunk(c);
+				continue;
+			}
+			size = chunkSize(c);
+		}
+		arena *a = ownerArena(ptr, size);
+		if (a != locked) {
+			if (locked != NULL) {
+				unlockArena(locked);
+			}
+			lockArena(a);
+			drainRemote(a);
+			locked = a;
+		}
+		arenaFree(a, ptr, size);
+	}
+	if (locked != NULL) {
+		unlockArena(locked);
+	}
+}
+// define myregion struct at the start of the chunk of a region, followed by the memory it hands out
+// magic tells a region apart from any other allocation, used is how many bytes have been handed out and count is in how many allocations,
+// file and line are where the region was created, and every live region is linked so that isMemoryLeaking can report what it holds
+struct myregion {
+	size_t magic;
+	size_t capacity;
+	size_t used;
+	size_t count;
+	char *file;
+	int line;
+	struct myregion *nextRegion;
+	struct myregion *prevRegion;
+};
+// enumeration for the magic number of a live region
+enum { REGIONMAGIC = 0x5245474e };
+static myregion *regions;
+
+// check that a pointer is a live region, or printf error message with file and line number and return false
+// without diagnostics, only a NULL pointer is turned away
+static bool isRegion(myregion *r, char *file, int line) {
+	if (r == NULL || (MYMALLOC_DIAGNOSTICS && r->magic != REGIONMAGIC)) {
+		printf("Error at file %s at line %d: pointer %p is not a region\n", file, line, (void *) r);
+		return false;
+	}
+	return true;
+}
+// create a region that can hand out capacity bytes, which is one chunk of the heap, or return NULL
+myregion *myregion_create(size_t capacity, char *file, int line) {
+	capacity = (capacity + MYMALLOC_ALIGNMENT - 1) & ~(size_t) (MYMALLOC_ALIGNMENT - 1);
+	if (capacity == 0 || capacity > SIZE_MAX - sizeof(myregion)) {
+		return NULL;
+	}
+	myregion *r = mymalloc(sizeof(myregion) + capacity, file, line);
+	if (r == NULL) {
+		return NULL;
+	}
+	r->magic = REGIONMAGIC;
+	r->capacity = capacity;
+	r->used = 0;
+	r->count = 0;
+	r->file = file;
+	r->line = line;
+	lockRegions();
+	r->prevRegion = NULL;
+	r->nextRegion = regions;
+	if (regions != NULL) {
+		regions->prevRegion = r;
+	}
+	regions = r;
+	unlockRegions();
+	return r;
+}
+// hand out size bytes of a region by bumping its used bytes, or return NULL if the region doesn't have enough left
+// the memory is aligned to MYMALLOC_ALIGNMENT bytes and is never freed on its own, only all at once by resetting or destroying the region
+void *myregion_alloc(myregion *r, size_t size, char *file, int line) {
+	if (!isRegion(r, file, line)) {
+		return NULL;
+	}
+	size = (size + MYMALLOC_ALIGNMENT - 1) & ~(size_t) (MYMALLOC_ALIGNMENT - 1);
+	if (size == 0 || size > r->capacity - r->used) {
+		return NULL;
+	}
+	void *ptr = (char *) r + sizeof(myregion) + r->used;
+	r->used += size;
+	r->count++;
+	return ptr;
+}
+// take back everything a region has handed out in O(1), so its memory can be handed out again
+void myregion_reset(myregion *r, char *file, int line) {
+	if (!isRegion(r, file, line)) {
+		return;
+	}
+	r->used = 0;
+	r->count = 0;
+}
+// give a region and everything it has handed out back to the heap in O(1) as the single chunk it is
+void myregion_destroy(myregion *r, char *file, int line) {
+	if (!isRegion(r, file, line)) {
+		return;
+	}
+	lockRegions();
+	if (r->prevRegion != NULL) {
+		r->prevRegion->nextRegion = r->nextRegion;
+	} else {
+		regions = r->nextRegion;
+	}
+	if (r->nextRegion != NULL) {
+		r->nextRegion->prevRegion = r->prevRegion;
+	}
+	unlockRegions();
+	r->magic = 0;
+	myfree(r, file, line);
+}
+// check memory leaks
+size_t isMemoryLeaking(void) {
+	// add up the allocated chunks of all arenas and the chunks with a mapping of their own
+	// if every allocated chunk is in a thread cache, then the user has freed all of them and there are no memory leaks
+	// so return false otherwise return true
+	size_t liveChunks = 0;
+	for (int i = 0; i < NARENAS; i++) {
+		liveChunks += arenaLiveChunks(&arenas[i]);
+	}
+	liveChunks += LOAD(&mappedChunks);
+	// a live region is one allocated chunk, so print what it holds to tell it apart from other leaks
+	lockRegions();
+	for (myregion *r = regions; r != NULL; r = r->nextRegion) {
+		printf("Region created at file %s at line %d holds %zu bytes in %zu allocations\n", r->file, r->line, r->used, r->count);
+	}
+	unlockRegions();
+	// the profiling build also prints the sites of the sampled allocations that are still live
+	printLeakingSites();
+	return liveChunks != countCachedChunks();
+
+}
+// get the number of bytes the heap takes from the OS, which are the memory arrays (unless the heap is growable),
+// and every segment, slab segment and chunk with a mapping of its own that is mapped
+size_t mymalloc_footprint(void) {
+	size_t footprint = LOAD(&mappedBytes);
+#ifndef MYMALLOC_GROWABLE
+	footprint += sizeof(mem);
+#endif
+	return footprint;
+}
+// give the whole pages in the data of a free chunk back to the OS with madvise(MADV_DONTNEED) and return how many bytes they hold
+// the tree block at the start of the data and the chunk struct after it stay, so the chunk keeps its place in the free block index,
+// and the pages read as zeros once they are touched again
+static size_t trimChunk(chunk *c, uintptr_t page) {
+	uintptr_t start = ((uintptr_t) chunkTree(c) + sizeof(treeBlock) + page - 1) & ~(page - 1);
+	uintptr_t end = (uintptr_t) nextChunk(c) & ~(page - 1);
+	// a segment backed by a huge page is kept whole, like releaseSegment keeps it
+	if (end <= start || isHugeSegment(segmentOf(c)) || madvise((void *) start, end - start, MADV_DONTNEED) != 0) {
+		return 0;
+	}
+	return end - start;
+}
+
+// trim every free chunk of the tree of a power-of-two bin, since only a chunk larger than SMALLMAX can hold a whole page
+static size_t trimTree(treeBlock *t, uintptr_t page) {
+	if (t == NULL) {
+		return 0;
+	}
+	return trimTree(t->left, page) + trimChunk(treeChunk(t), page) + trimTree(t->right, page);
+}
+
+// give back the remote queues and coalesce the deferred chunks of every arena, then give every whole page in the free chunks back to the OS,
+// and return how many bytes those pages hold (a page that an earlier call gave back is counted again)
+// the cache of the calling thread is flushed first, so that its chunks are coalesced as well, but the caches of other threads are left alone
+size_t mymalloc_trim(void) {
+	flushThreadCache();
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	size_t trimmed = 0;
+	for (int i = 0; i < NARENAS; i++) {
+		arena *a = &arenas[i];
+		lockArena(a);
+		drainRemote(a);
+		coalesceDeferred(a);
+		for (size_t index = SMALLBINS; index < NBINS; index++) {
+			trimmed += trimTree(a->trees[index - SMALLBINS], page);
+		}
+		unlockArena(a);
+	}
+	return trimmed;
+}
+// find the data size of the largest free chunk of an arena
+// the highest non-empty bin holds it, which is found with the bitmap, and the root of a power-of-two bin keeps the largest data size in its tree
+static size_t largestFreeChunk(arena *a) {
+	for (size_t word = NBINS / 64; word-- > 0;) {
+		if (a->binmap[word] == 0) {
+			continue;
+		}
+		size_t index = word * 64 + 63 - __builtin_clzll(a->binmap[word]);
+		if (index < SMALLBINS) {
+			return (index + 1) << 3;
+		}
+		return a->trees[index - SMALLBINS]->maxSize;
+	}
+	return 0;
+}
+
+// add the counters of one arena (or of the chunks with a mapping of their own) to stats
+static void addStats(mystats *stats, heapStats *h) {
+	stats->liveBytes += h->liveBytes;
+	stats->liveBlocks += h->liveBlocks;
+	stats->headerBytes += h->headerBytes;
+	stats->freeBytes += h->freeBytes;
+	stats->freeChunks += h->freeChunks;
+	stats->slabBytes += h->slabs * SLABSIZE;
+	stats->peakLiveBytes += h->peakLiveBytes;
+	stats->peakLiveBlocks += h->peakLiveBlocks;
+	for (int i = 0; i < MYSTATS_CLASSES; i++) {
+		stats->sizeClasses[i] += h->classes[i];
+	}
+}
+
+// fill stats with the shape of the heap from the counters that every arena keeps as it allocates and frees, without walking any chunks
+// the high-water marks are kept per arena and added up, so in the thread-safe build they are an upper bound of the heap-wide high-water marks,
+// and they count the blocks in thread caches as live
+// external fragmentation is the part of the free bytes that is not in the largest free chunk, so 0 means every free byte is in one chunk
+// nodes is the number of NUMA nodes the arenas are spread over, which is 1 unless the NUMA build finds more, and the NUMA build counts the frees
+// of memory from the node of the freeing thread (localFrees) and from another node (remoteFrees), which are 0 in the other builds
+// hugeBytes is the part of the footprint in segments that are backed by huge pages, which is 0 unless the huge page build gets them
+// (a segment with transparent huge pages is counted once madvise accepts it, though the kernel may still give it small pages when it has no huge page free)
+void mymalloc_stats(mystats *stats) {
+	memset(stats, 0, sizeof(mystats));
+	stats->chunkHeader = sizeof(chunk);
+	stats->nodes = 1;
+#ifdef MYMALLOC_NUMA
+	countNodeFrees(stats);
+#endif
+	for (int i = 0; i < NARENAS; i++) {
+		arena *a = &arenas[i];
+		lockArena(a);
+		drainRemote(a);
+		addStats(stats, &a->stats);
+		size_t largest = largestFreeChunk(a);
+		if (largest > stats->largestFree) {
+			stats->largestFree = largest;
+		}
+		unlockArena(a);
+	}
+#ifdef MYMALLOC_THREADS
+	addStats(stats, lockMappedStats());
+	unlockMappedStats();
+#endif
+	uncountCached(stats);
+	if (stats->freeBytes > 0) {
+		stats->fragmentation = 1.0 - (double) stats->largestFree / stats->freeBytes;
+	}
+	stats->footprint = mymalloc_footprint();
+	stats->peakFootprint = LOAD(&peakMappedBytes);
+#ifdef MYMALLOC_HUGEPAGES
+	stats->hugeBytes = LOAD(&hugeBytes);
+#endif
+#ifndef MYMALLOC_GROWABLE
+	stats->peakFootprint += sizeof(mem);
+#endif
+}
+// printf error message of the heap check with the address where the problem was found, and count it
+static size_t heapProblem(char *problem, void *address) {
+	printf("Error in heap check: %s at %p\n", problem, address);
+	return 1;
+}
+
+// check whether a chunk lies in one of the segments of an arena, after the reserved struct
+static bool isArenaChunk(arena *a, chunk *c) {
+#ifdef MYMALLOC_GROWABLE
+	return segmentKind(c) == HEAPSEGMENT && segmentArena(segmentOf(c)) == a && (char *) c >= (char *) firstChunk(segmentOf(c));
+#else
+	reserved *res = (reserved *) mem[a - arenas];
+	return (char *) c >= (char *) firstChunk(res) && (char *) c < (char *) res + SEGMENTSIZE;
+#endif
+}
+
+// walk the chunks of a segment from the first chunk to the end of the segment and check that every chunk is in bounds and aligned,
+// that its boundary tag matches the chunk before it, that no two free chunks are next to each other and that its start is marked,
+// and add up its free chunks for the check of the free block index
+// a chunk whose data size runs past the end of the segment stops the walk, since the chunks after it can't be found
+static size_t checkSegment(reserved *res, size_t *freeChunks, size_t *freeBytes) {
+	size_t problems = 0;
+	size_t chunks = 0;
+	size_t allocated = 0;
+	char *end = (char *) res + SEGMENTSIZE;
+	chunk *prev = NULL;
+	for (chunk *c = firstChunk(res); (char *) c < end; c = nextChunk(c)) {
+		size_t size = chunkSize(c);
+		if (size < MINDATA || size > (size_t) (end - (char *) c) - sizeof(chunk)) {
+			return problems + heapProblem("chunk runs past the end of its segment", c);
+		}
+		if ((uintptr_t) chunkBlock(c) % MYMALLOC_ALIGNMENT != 0) {
+			problems += heapProblem("chunk data is not aligned", c);
+		}
+		if (isMapped(c) || ((LOAD(&c->dataSize) & CACHED) != 0 && !isAllocated(c))) {
+			problems += heapProblem("chunk has invalid status bits", c);
+		}
+		if (prev != NULL && LOAD(&c->prevSize) != chunkSize(prev)) {
+			problems += heapProblem("boundary tag does not match the previous chunk", c);
+		}
+		if (prev != NULL && !isAllocated(prev) && !isAllocated(c)) {
+			problems += heapProblem("free chunk is not coalesced with the previous chunk", c);
+		}
+#if MYMALLOC_DIAGNOSTICS
+		size_t word = ((char *) c - (char *) res) >> 3;
+		if ((LOAD(&segmentStarts(res)[word >> 6]) & ((uint64_t) 1 << (word & 63))) == 0) {
+			problems += heapProblem("chunk start is not marked in the chunk start bitmap", c);
+		}
+#endif
+#ifdef MYMALLOC_HARDENED
+		if (!isIntact(c)) {
+			problems += heapProblem("chunk canary is overwritten", c);
+		}
+#endif
+		if (isAllocated(c)) {
+			allocated++;
+		} else {
+			(*freeChunks)++;
+			*freeBytes += size;
+		}
+		chunks++;
+		prev = c;
+	}
+	if (allocated != res->liveChunks) {
+		problems += heapProblem("live chunk count does not match the allocated chunks of the segment", res);
+	}
+#if MYMALLOC_DIAGNOSTICS
+	// every bit of the chunk start bitmap must belong to one of the chunks that were walked
+	size_t marked = 0;
+	for (size_t i = 0; i < (SEGMENTSIZE / 8 + 63) / 64; i++) {
+		marked += __builtin_popcountll(LOAD(&segmentStarts(res)[i]));
+	}
+	if (marked != chunks) {
+		problems += heapProblem("chunk start bitmap marks an address that is not a chunk", res);
+	}
+#endif
+	return problems;
+}
+
+// check the tree of a power-of-two bin in order: every node is a free chunk of the arena whose data size belongs in the bin,
+// the nodes are in the order of the tree, every node keeps the largest data size in its subtree and no child has a higher priority than its parent
+// prev is the node before the subtree in order, and a tree that holds more nodes than there are free chunks has a cycle or a foreign node,
+// so listed is set past freeChunks and the check stops there
+static size_t checkTree(arena *a, treeBlock *t, size_t index, size_t freeChunks, treeBlock **prev, size_t *listed, size_t *listedBytes) {
+	if (t == NULL || *listed > freeChunks) {
+		return 0;
+	}
+	chunk *c = treeChunk(t);
+	if (++*listed > freeChunks || !isArenaChunk(a, c)) {
+		*listed = freeChunks + 1;
+		return heapProblem("free block is not a free chunk of its arena", t);
+	}
+	size_t problems = checkTree(a, t->left, index, freeChunks, prev, listed, listedBytes);
+	if (*listed > freeChunks) {
+		return problems;
+	}
+	if (isAllocated(c)) {
+		problems += heapProblem("allocated chunk is in a bin", t);
+	}
+	if (binIndex(chunkSize(c)) != index) {
+		problems += heapProblem("free chunk is in the wrong bin", t);
+	}
+	if (*prev != NULL && !isBefore(*prev, t)) {
+		problems += heapProblem("tree of a power-of-two bin is out of order", t);
+	}
+	*listedBytes += chunkSize(c);
+	*prev = t;
+	problems += checkTree(a, t->right, index, freeChunks, prev, listed, listedBytes);
+	if (*listed > freeChunks) {
+		return problems;
+	}
+	size_t maxSize = chunkSize(c);
+	if (t->left != NULL && t->left->maxSize > maxSize) {
+		maxSize = t->left->maxSize;
+	}
+	if (t->right != NULL && t->right->maxSize > maxSize) {
+		maxSize = t->right->maxSize;
+	}
+	if (t->maxSize != maxSize) {
+		problems += heapProblem("tree block does not keep the largest data size of its subtree", t);
+	}
+	if ((t->left != NULL && treePriority(t->left) > treePriority(t)) || (t->right != NULL && treePriority(t->right) > treePriority(t))) {
+		problems += heapProblem("tree block has a lower priority than its child", t);
+	}
+	return problems;
+}
+
+// check the free block index of an arena against the free chunks found by walking its segments:
+// every block of an exact bin is a free chunk of the arena whose data size belongs in the bin and the links agree in both directions,
+// the tree of every power-of-two bin passes checkTree, the bin bitmap marks exactly the bins that are not empty,
+// and the bins hold as many free chunks and free bytes as the segments and the stats
+// a bin that holds more blocks than there are free chunks has a cycle or a foreign block, so the check stops there
+static size_t checkBins(arena *a, size_t freeChunks, size_t freeBytes) {
+	size_t problems = 0;
+	size_t listed = 0;
+	size_t listedBytes = 0;
+	for (size_t index = 0; index < NBINS; index++) {
+		bool marked = (a->binmap[index >> 6] & ((uint64_t) 1 << (index & 63))) != 0;
+		if (index >= SMALLBINS) {
+			if (marked != (a->trees[index - SMALLBINS] != NULL)) {
+				problems += heapProblem("bin bitmap does not match the bin", &a->trees[index - SMALLBINS]);
+			}
+			treeBlock *prev = NULL;
+			problems += checkTree(a, a->trees[index - SMALLBINS], index, freeChunks, &prev, &listed, &listedBytes);
+			if (listed > freeChunks) {
+				return problems;
+			}
+			continue;
+		}
+		if (marked != (a->bins[index] != NULL)) {
+			problems += heapProblem("bin bitmap does not match the bin", &a->bins[index]);
+		}
+		freeBlock *prevFree = NULL;
+		for (freeBlock *block = a->bins[index]; block != NULL; block = block->nextFree) {
+			chunk *c = blockChunk(block);
+			if (++listed > freeChunks || !isArenaChunk(a, c)) {
+				return problems + heapProblem("free block is not a free chunk of its arena", block);
+			}
+			if (isAllocated(c)) {
+				problems += heapProblem("allocated chunk is in a bin", block);
+			}
+			if (binIndex(chunkSize(c)) != index) {
+				problems += heapProblem("free chunk is in the wrong bin", block);
+			}
+			if (block->prevFree != prevFree) {
+				problems += heapProblem("free block links do not agree", block);
+			}
+			listedBytes += chunkSize(c);
+			prevFree = block;
+		}
+	}
+	if (listed != freeChunks || listedBytes != freeBytes) {
+		problems += heapProblem("bins do not hold every free chunk", a);
+	}
+	if (a->stats.freeChunks != freeChunks || a->stats.freeBytes != freeBytes) {
+		problems += heapProblem("free chunk counters do not match the free chunks", a);
+	}
+	return problems;
+}
+
+#ifdef MYMALLOC_DEFERRED
+// check the deferred list of an arena: every chunk on it is a chunk of the arena that is allocated and cached, and the list holds as many chunks
+// as its count, so a list that runs past its count has a cycle or a foreign chunk and the check stops there
+static size_t checkDeferred(arena *a) {
+	size_t problems = 0;
+	size_t listed = 0;
+	for (freeBlock *block = a->deferred; block != NULL; block = block->nextFree) {
+		chunk *c = blockChunk(block);
+		if (++listed > a->deferredChunks || !isArenaChunk(a, c)) {
+			return problems + heapProblem("deferred block is not a deferred chunk of its arena", block);
+		}
+		if ((LOAD(&c->dataSize) & (ALLOCATED | CACHED)) != (ALLOCATED | CACHED)) {
+			problems += heapProblem("deferred chunk is not marked as cached", block);
+		}
+	}
+	if (listed != a->deferredChunks) {
+		problems += heapProblem("deferred chunk count does not match the deferred list", a);
+	}
+	return problems;
+}
+#else
+static size_t checkDeferred(arena *a) {
+	return 0;
+}
+#endif
+
+// check the slab tier of an arena: every slab carved from its slab segments has a valid slot size, its bits past the last slot are set,
+// only allocated slots are cached and its free slot count matches its bits, every slab segment counts its allocated slots,
+// and every slab is in the list its free slots call for, which is the list of its size class, the empty list, or no list once it is full
+static size_t checkSlabs(arena *a) {
+	size_t problems = 0;
+	size_t slabs = 0;
+	size_t full = 0;
+	slabSegment *prevSegment = NULL;
+	for (slabSegment *seg = a->slabSegments; seg != NULL; seg = seg->nextSegment) {
+		if (segmentKind(seg) != SLABSEGMENT || seg->owner != a || seg->prevSegment != prevSegment || seg->carved < 1 || seg->carved > SLABPAGES) {
+			return problems + heapProblem("slab segment list is broken", seg);
+		}
+		size_t live = 0;
+		for (size_t page = 1; page < seg->carved; page++) {
+			slab *s = (slab *) ((char *) seg + page * SLABSIZE);
+			size_t size = LOAD(&s->slotSize);
+			if (size < MINDATA || size > MYMALLOC_SLABMAX || size % MYMALLOC_ALIGNMENT != 0) {
+				problems += heapProblem("slab has an invalid slot size", s);
+				continue;
+			}
+			size_t slots = slabSlots(size);
+			size_t used = 0;
+			for (size_t word = 0; word < SLABWORDS; word++) {
+				uint64_t past = 0;
+				if (slots <= word * 64) {
+					past = ~(uint64_t) 0;
+				} else if (slots < (word + 1) * 64) {
+					past = ~(uint64_t) 0 << (slots - word * 64);
+				}
+				uint64_t usedBits = LOAD(&s->used[word]);
+				if ((usedBits & past) != past || (LOAD(&s->cached[word]) & ~usedBits) != 0) {
+					problems += heapProblem("slab has invalid slot bits", s);
+				}
+				used += __builtin_popcountll(usedBits & ~past);
+			}
+			if (s->freeSlots != slots - used) {
+				problems += heapProblem("free slot count does not match the slot bits", s);
+			}
+			if (s->freeSlots == 0) {
+				full++;
+			}
+			live += used;
+		}
+		if (live != seg->liveSlots) {
+			problems += heapProblem("live slot count does not match the allocated slots of the slab segment", seg);
+		}
+		slabs += seg->carved - 1;
+		prevSegment = seg;
+	}
+	// a slab list that holds more slabs than were carved has a cycle or a foreign slab, so the check stops there
+	size_t listed = 0;
+	for (size_t index = 0; index <= SLABCLASSES; index++) {
+		slab **list = index < SLABCLASSES ? &a->partialSlabs[index] : &a->emptySlabs;
+		slab *prevSlab = NULL;
+		for (slab *s = *list; s != NULL; s = s->nextSlab) {
+			if (++listed > slabs || segmentKind(s) != SLABSEGMENT) {
+				return problems + heapProblem("slab list holds a slab that was not carved", s);
+			}
+			bool isEmpty = s->freeSlots == slabSlots(s->slotSize);
+			if (index < SLABCLASSES ? slabClass(s->slotSize) != index || s->freeSlots == 0 || isEmpty : !isEmpty) {
+				problems += heapProblem("slab is in the wrong list", s);
+			}
+			if (s->prevSlab != prevSlab) {
+				problems += heapProblem("slab links do not agree", s);
+			}
+			prevSlab = s;
+		}
+	}
+	if (listed + full != slabs || a->stats.slabs != slabs) {
+		problems += heapProblem("slab lists do not hold every slab", a);
+	}
+	return problems;
+}
+
+// check the whole heap for consistency, arena by arena under its lock, and printf error message for every problem that is found
+// and return how many there are, so 0 means the heap is consistent
+// the segments, free block index, deferred list and slab tier of every arena are checked against each other, which walks every chunk and slab,
+// so this is meant for tests and fuzzing and not for the hot path
+// chunks with a mapping of their own are not linked anywhere, so they are only checked when they are freed
+size_t mymalloc_check_heap(void) {
+	size_t problems = 0;
+	for (int i = 0; i < NARENAS; i++) {
+		arena *a = &arenas[i];
+		lockArena(a);
+		size_t freeChunks = 0;
+		size_t freeBytes = 0;
+#ifdef MYMALLOC_GROWABLE
+		reserved *prevSegment = NULL;
+		for (reserved *res = a->segments; res != NULL; res = res->nextSegment) {
+			if (segmentKind(res) != HEAPSEGMENT || res->owner != a || res->prevSegment != prevSegment) {
+				problems += heapProblem("segment list is broken", res);
+				break;
+			}
+			problems += checkSegment(res, &freeChunks, &freeBytes);
+			prevSegment = res;
+		}
+#else
+		// a memory array that has never been used has no chunks yet
+		reserved *res = (reserved *) mem[i];
+		if (LOAD(&firstChunk(res)->dataSize) != 0) {
+			problems += checkSegment(res, &freeChunks, &freeBytes);
+		}
+#endif
+		problems += checkBins(a, freeChunks, freeBytes);
+		problems += checkDeferred(a);
+		problems += checkSlabs(a);
+		unlockArena(a);
+	}
+	return problems;
 }
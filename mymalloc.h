@@ -1,12 +1,80 @@
 #ifndef _MYMALLOC_H
 #define _MYMALLOC_H
 
+#include <stddef.h>
+
+// the macros that route the standard names to the allocator with the file and line of every call are opt-in,
+// so a program that links the library normally only sees the functions below, and a program that wants them defines MYMALLOC_MACROS first
+#ifdef MYMALLOC_MACROS
 #define malloc(s)   mymalloc(s, __FILE__, __LINE__)
 #define free(p)     myfree(p, __FILE__, __LINE__)
+#define realloc(p, s) myrealloc(p, s, __FILE__, __LINE__)
+#define calloc(n, s) mycalloc(n, s, __FILE__, __LINE__)
+#define aligned_alloc(a, s) myaligned_alloc(a, s, __FILE__, __LINE__)
+#define posix_memalign(p, a, s) myposix_memalign(p, a, s, __FILE__, __LINE__)
+#define malloc_usable_size(p) mymalloc_usable_size(p, __FILE__, __LINE__)
+#define malloc_batch(s, n, p) mymalloc_batch(s, n, p, __FILE__, __LINE__)
+#define free_batch(p, n) myfree_batch(p, n, __FILE__, __LINE__)
+#define region_create(s) myregion_create(s, __FILE__, __LINE__)
+#define region_alloc(r, s) myregion_alloc(r, s, __FILE__, __LINE__)
+#define region_reset(r) myregion_reset(r, __FILE__, __LINE__)
+#define region_destroy(r) myregion_destroy(r, __FILE__, __LINE__)
+#endif
+
+// the functions below are the exported API of the library, and everything else in it is hidden
+#define MYMALLOC_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-void *mymalloc(size_t size, char *file, int line);
-void myfree(void *ptr, char *file, int line);
-size_t isMemoryLeaking();
+#define MYSTATS_CLASSES 48
+
+typedef struct myregion myregion;
+
+typedef struct mystats {
+	size_t liveBytes;
+	size_t liveBlocks;
+	size_t headerBytes;
+	size_t chunkHeader;
+	size_t freeBytes;
+	size_t freeChunks;
+	size_t largestFree;
+	double fragmentation;
+	size_t slabBytes;
+	size_t footprint;
+	size_t peakLiveBytes;
+	size_t peakLiveBlocks;
+	size_t peakFootprint;
+	size_t nodes;
+	size_t localFrees;
+	size_t remoteFrees;
+	size_t hugeBytes;
+	size_t sizeClasses[MYSTATS_CLASSES];
+} mystats;
+
+MYMALLOC_API void *mymalloc(size_t size, char *file, int line);
+MYMALLOC_API void myfree(void *ptr, char *file, int line);
+MYMALLOC_API void *myrealloc(void *ptr, size_t size, char *file, int line);
+MYMALLOC_API void *mycalloc(size_t count, size_t size, char *file, int line);
+MYMALLOC_API void *myaligned_alloc(size_t alignment, size_t size, char *file, int line);
+MYMALLOC_API int myposix_memalign(void **memptr, size_t alignment, size_t size, char *file, int line);
+MYMALLOC_API size_t mymalloc_usable_size(void *ptr, char *file, int line);
+MYMALLOC_API size_t mymalloc_batch(size_t size, size_t count, void **ptrs, char *file, int line);
+MYMALLOC_API void myfree_batch(void **ptrs, size_t count, char *file, int line);
+MYMALLOC_API myregion *myregion_create(size_t capacity, char *file, int line);
+MYMALLOC_API void *myregion_alloc(myregion *r, size_t size, char *file, int line);
+MYMALLOC_API void myregion_reset(myregion *r, char *file, int line);
+MYMALLOC_API void myregion_destroy(myregion *r, char *file, int line);
+MYMALLOC_API size_t isMemoryLeaking(void);
+MYMALLOC_API size_t mymalloc_footprint(void);
+MYMALLOC_API void mymalloc_stats(mystats *stats);
+MYMALLOC_API size_t mymalloc_trim(void);
+MYMALLOC_API size_t mymalloc_check_heap(void);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
 
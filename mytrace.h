@@ -0,0 +1,38 @@
+#ifndef _MYTRACE_H
+#define _MYTRACE_H
+
+#include <stdint.h>
+
+// enumeration for the version of the trace format and the operations in a trace
+enum {
+	TRACEVERSION = 1,
+	TRACEMALLOC = 1,
+	TRACECALLOC,
+	TRACEALIGNED,
+	TRACEREALLOC,
+	TRACEFREE
+};
+
+// define traceHeader struct at the start of a trace file, which is followed by one traceEvent for every call that was recorded
+// magic is "MYTRACE1" and eventSize is the size of the traceEvent struct, so that a reader can tell whether it understands the file
+typedef struct traceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t eventSize;
+} traceHeader;
+
+// define traceEvent struct for one call, in the order in which the calls took effect
+// time is in nanoseconds since the trace started and size is the size that was asked for (count * size for calloc)
+// id names the allocation from the call that allocated it to the call that freed it, and the id of a freed allocation is reused,
+// so ids stay below the largest number of allocations live at once
+// thread numbers the threads from 1 in the order of their first call (0 in the single-threaded build) and alignShift is log2 of the alignment
+typedef struct traceEvent {
+	uint64_t time;
+	uint64_t size;
+	uint32_t id;
+	uint16_t thread;
+	uint8_t op;
+	uint8_t alignShift;
+} traceEvent;
+
+#endif
@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "mymalloc.h"
+
+// Replace the allocator of the C library in a program that was not compiled against mymalloc.h by loading this file as a shared object with
+// LD_PRELOAD=./libmymalloc_preload.so program, which is built from this file and the thread-safe growable build of mymalloc.c.
+// The dynamic linker binds every call to malloc() and friends in the program and its libraries to the functions below,
+// including the calls the C library makes itself, so every allocation comes from the same heap and is freed into it.
+// The heap needs no setup, since its state is static and zero or initialized at compile time, so a call during early startup,
+// before any constructor has run, works like any other. mymalloc.c takes every lock of the heap around fork(), so the child of a
+// multi-threaded program gets a consistent heap.
+// Unlike the macros, these functions return a unique pointer for a size of 0 and set errno to ENOMEM when they fail, like the C library.
+
+// set errno to ENOMEM if an allocation failed and return it
+static void *checkAllocation(void *ptr) {
+	if (ptr == NULL) {
+		errno = ENOMEM;
+	}
+	return ptr;
+}
+
+// round an alignment up to a power of two, since memalign() accepts any alignment
+static size_t roundAlignment(size_t alignment) {
+	size_t power = sizeof(void *);
+	while (power < alignment && power != 0) {
+		power <<= 1;
+	}
+	return power;
+}
+
+MYMALLOC_API void *malloc(size_t size) {
+	return checkAllocation(mymalloc(size == 0 ? 1 : size, __FILE__, __LINE__));
+}
+
+MYMALLOC_API void free(void *ptr) {
+	// free(NULL) does nothing, and a failed munmap must not change errno, which some programs read after free()
+	if (ptr == NULL) {
+		return;
+	}
+	int saved = errno;
+	myfree(ptr, __FILE__, __LINE__);
+	errno = saved;
+}
+
+MYMALLOC_API void *calloc(size_t count, size_t size) {
+	if (count == 0 || size == 0) {
+		count = 1;
+		size = 1;
+	}
+	return checkAllocation(mycalloc(count, size, __FILE__, __LINE__));
+}
+
+MYMALLOC_API void *realloc(void *ptr, size_t size) {
+	// realloc(ptr, 0) frees the pointer and returns NULL, like the C library
+	if (ptr != NULL && size == 0) {
+		free(ptr);
+		return NULL;
+	}
+	return checkAllocation(myrealloc(ptr, size == 0 ? 1 : size, __FILE__, __LINE__));
+}
+
+MYMALLOC_API void *aligned_alloc(size_t alignment, size_t size) {
+	return checkAllocation(myaligned_alloc(roundAlignment(alignment), size == 0 ? 1 : size, __FILE__, __LINE__));
+}
+
+MYMALLOC_API void *memalign(size_t alignment, size_t size) {
+	return aligned_alloc(alignment, size);
+}
+
+MYMALLOC_API int posix_memalign(void **memptr, size_t alignment, size_t size) {
+	return myposix_memalign(memptr, alignment, size == 0 ? 1 : size, __FILE__, __LINE__);
+}
+
+MYMALLOC_API void *valloc(size_t size) {
+	return aligned_alloc(sysconf(_SC_PAGESIZE), size);
+}
+
+// pvalloc() also rounds the size up to whole pages
+MYMALLOC_API void *pvalloc(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	if (size > SIZE_MAX - page) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+MYMALLOC_API size_t malloc_usable_size(void *ptr) {
+	return mymalloc_usable_size(ptr, __FILE__, __LINE__);
+}
+
+// the pad of the C library is not needed, since only whole free pages are given back and the heap keeps its free chunks
+MYMALLOC_API int malloc_trim(size_t pad) {
+	return mymalloc_trim() > 0;
+}
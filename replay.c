@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// malloc() and the other standard names go to the allocator with the file and line of every call
+#define MYMALLOC_MACROS
+#include "mymalloc.h"
+#include "mytrace.h"
+
+// enumeration for the number of bytes of the trace that are mapped at a time, which is a multiple of the page size,
+// and the initial number of allocations in the table of live allocations
+enum {
+	WINDOW = 64 * 1024 * 1024,
+	LIVESLOTS = 1 << 16
+};
+
+// define allocation struct for the table of live allocations, which is indexed by the id of an allocation in the trace
+typedef struct allocation {
+	void *ptr;
+	size_t size;
+} allocation;
+
+// the table is mapped with mmap and grown with mremap, so it doesn't take memory from the heap that is being measured
+static allocation *live;
+static size_t liveCapacity;
+
+// read the raw monotonic clock in nanoseconds
+static uint64_t now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+}
+
+// get the entry of an id in the table of live allocations, growing the table if the id is past its end
+static allocation *getAllocation(uint32_t id) {
+	if (id >= liveCapacity) {
+		size_t capacity = liveCapacity;
+		while (id >= capacity) {
+			capacity *= 2;
+		}
+		allocation *grown = mremap(live, liveCapacity * sizeof(allocation), capacity * sizeof(allocation), MREMAP_MAYMOVE);
+		if (grown == MAP_FAILED) {
+			printf("Error: could not grow the table of live allocations\n");
+			exit(EXIT_FAILURE);
+		}
+		live = grown;
+		liveCapacity = capacity;
+	}
+	return &live[id];
+}
+
+// Replay a trace recorded by the trace build (-DMYMALLOC_TRACE) against the allocator as fast as possible, one event after another,
+// and report the throughput, the peak footprint of the heap and how fragmented it was at that peak.
+// The trace is mapped WINDOW bytes at a time and each window is unmapped once it is replayed, so a trace of any length replays in bounded memory.
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		printf("Usage: %s trace\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		printf("Error: could not open trace file %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	size_t fileSize = st.st_size;
+	traceHeader header;
+	if (fileSize < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, "MYTRACE1", 8) != 0 ||
+		header.version != TRACEVERSION || header.eventSize != sizeof(traceEvent)) {
+		printf("Error: %s is not a trace file of this version\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	live = mmap(NULL, LIVESLOTS * sizeof(allocation), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (live == MAP_FAILED) {
+		printf("Error: could not map the table of live allocations\n");
+		return EXIT_FAILURE;
+	}
+	liveCapacity = LIVESLOTS;
+
+	size_t events = 0;
+	size_t failed = 0;
+	size_t liveCount = 0;
+	size_t liveBytes = 0;
+	size_t peakLiveBytes = 0;
+	size_t peakFootprint = 0;
+	uint64_t traceTime = 0;
+	uint16_t threads = 0;
+	uint64_t start = now();
+	// map the window that holds the next event, with room for one more event, so an event that starts in the window is always whole
+	// then replay the events that start in it, and move on to the next window
+	size_t pos = sizeof(header);
+	while (pos + sizeof(traceEvent) <= fileSize) {
+		size_t base = pos & ~(size_t) (WINDOW - 1);
+		size_t length = WINDOW + sizeof(traceEvent);
+		if (length > fileSize - base) {
+			length = fileSize - base;
+		}
+		char *window = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, base);
+		if (window == MAP_FAILED) {
+			printf("Error: could not map trace file %s\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+		madvise(window, length, MADV_SEQUENTIAL);
+		while (pos < base + WINDOW && pos + sizeof(traceEvent) <= base + length) {
+			traceEvent *e = (traceEvent *) (window + pos - base);
+			allocation *a = getAllocation(e->id);
+			void *ptr;
+			switch (e->op) {
+			case TRACEMALLOC:
+			case TRACECALLOC:
+			case TRACEALIGNED:
+				if (e->op == TRACEMALLOC) {
+					ptr = malloc(e->size);
+				} else if (e->op == TRACECALLOC) {
+					ptr = calloc(e->size, 1);
+				} else {
+					ptr = aligned_alloc((size_t) 1 << e->alignShift, e->size);
+				}
+				if (ptr == NULL) {
+					failed++;
+					break;
+				}
+				// an id that is still live means an event was lost, so the old allocation is freed to keep the table consistent
+				if (a->ptr != NULL) {
+					free(a->ptr);
+					liveBytes -= a->size;
+					liveCount--;
+				}
+				a->ptr = ptr;
+				a->size = e->size;
+				liveBytes += e->size;
+				liveCount++;
+				break;
+			case TRACEREALLOC:
+				// an allocation whose own call failed during the replay is allocated by realloc, like realloc(NULL, size)
+				ptr = realloc(a->ptr, e->size);
+				if (ptr == NULL) {
+					failed++;
+					break;
+				}
+				if (a->ptr == NULL) {
+					liveCount++;
+				}
+				liveBytes += e->size - a->size;
+				a->ptr = ptr;
+				a->size = e->size;
+				break;
+			case TRACEFREE:
+				if (a->ptr != NULL) {
+					free(a->ptr);
+					liveBytes -= a->size;
+					liveCount--;
+					a->ptr = NULL;
+					a->size = 0;
+				}
+				break;
+			default:
+				printf("Error: unknown operation %d at byte %zu of trace file %s\n", e->op, pos, argv[1]);
+				return EXIT_FAILURE;
+			}
+			// the footprint is read after every event, so its peak is exact
+			size_t footprint = mymalloc_footprint();
+			if (footprint > peakFootprint) {
+				peakFootprint = footprint;
+			}
+			if (liveBytes > peakLiveBytes) {
+				peakLiveBytes = liveBytes;
+			}
+			if (e->thread > threads) {
+				threads = e->thread;
+			}
+			traceTime = e->time;
+			events++;
+			pos += sizeof(traceEvent);
+		}
+		munmap(window, length);
+	}
+	uint64_t elapsed = now() - start;
+	close(fd);
+
+	double seconds = elapsed / 1e9;
+	printf("Replayed %zu events recorded from %d threads in %f seconds (recorded in %f seconds)\n", events, threads > 0 ? threads : 1,
+		seconds, traceTime / 1e9);
+	printf("Throughput: %.0f events per second\n", seconds > 0 ? events / seconds : 0);
+	printf("Peak live bytes: %zu\n", peakLiveBytes);
+	// fragmentation is the part of the peak footprint that the peak live bytes did not need
+	printf("Peak footprint: %zu bytes, fragmentation %.1f%%\n", peakFootprint,
+		peakFootprint > peakLiveBytes ? 100.0 * (peakFootprint - peakLiveBytes) / peakFootprint : 0);
+	printf("Failed allocations: %zu\n", failed);
+	printf("Live at the end of the trace: %zu allocations of %zu bytes\n", liveCount, liveBytes);
+
+	// free what the trace left live, so that the leak check only reports the replay itself
+	for (size_t id = 0; id < liveCapacity; id++) {
+		if (live[id].ptr != NULL) {
+			free(live[id].ptr);
+		}
+	}
+	munmap(live, liveCapacity * sizeof(allocation));
+	if (isMemoryLeaking()) {
+		printf("Memory leak detected!\n");
+	} else {
+		printf("No memory leak detected!\n");
+	}
+	return EXIT_SUCCESS;
+}